@@ -0,0 +1,99 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+
+#ifndef CONCURRENTCOLLECTIONS_ALGORITHM_H_
+#define CONCURRENTCOLLECTIONS_ALGORITHM_H_
+
+#include <ccol/common.h>
+#include <ccol/simd.h>
+
+#include <optional>
+
+namespace ccol {
+
+/// \brief A container whose elements sit in one contiguous buffer that can be accessed in bulk,
+/// like trivial_vector and static_trivial_vector.
+template <typename TContainer>
+concept contiguous_container = requires(TContainer& container, const TContainer& const_container) {
+  typename TContainer::value_type;
+  const_container.read([](std::span<const typename TContainer::value_type>) {});
+  container.write([](std::span<typename TContainer::value_type>) {});
+};
+
+// The functions below enter the container once for the whole pass instead of once per element: reads go
+// through read(), which pins the epoch for trivial_vector and takes nothing for static_trivial_vector, and
+// in-place updates go through write(), which holds the write lock once.
+// 32-bit integers and floats use AVX2, SSE4.1, SSE2 or NEON depending on what the code is compiled for
+// (x86-64 builds get SSE2 by default, see ConcurrentCollections_NATIVE_ARCH for more),
+// everything else runs a scalar loop over the contiguous buffer. See ccol::simd_instruction_set.
+
+/// \returns The index of the first element equal to \p value, if any.
+template <contiguous_container TContainer>
+std::optional<typename TContainer::size_type> find(const TContainer& container, typename TContainer::value_type value) {
+  return container.read([value](auto values) -> std::optional<typename TContainer::size_type> {
+    const std::size_t index = detail::simd_find(values, value);
+    if (index == values.size()) {
+      return std::nullopt;
+    }
+    return index;
+  });
+}
+
+/// \returns The number of elements equal to \p value.
+template <contiguous_container TContainer>
+typename TContainer::size_type count(const TContainer& container, typename TContainer::value_type value) {
+  return container.read([value](auto values) { return detail::simd_count(values, value); });
+}
+
+/// \brief Sets every element to \p value.
+template <contiguous_container TContainer>
+void fill(TContainer& container, typename TContainer::value_type value) {
+  container.write([value](auto values) { std::fill(values.begin(), values.end(), value); });
+}
+
+/// \returns The smallest element, or nothing if the container is empty. NaNs are not handled.
+template <contiguous_container TContainer>
+std::optional<typename TContainer::value_type> min_value(const TContainer& container) {
+  return container.read([](auto values) -> std::optional<typename TContainer::value_type> {
+    if (values.empty()) {
+      return std::nullopt;
+    }
+    return detail::simd_min(values);
+  });
+}
+
+/// \returns The largest element, or nothing if the container is empty. NaNs are not handled.
+template <contiguous_container TContainer>
+std::optional<typename TContainer::value_type> max_value(const TContainer& container) {
+  return container.read([](auto values) -> std::optional<typename TContainer::value_type> {
+    if (values.empty()) {
+      return std::nullopt;
+    }
+    return detail::simd_max(values);
+  });
+}
+
+/// \returns The sum of the elements. Integers wrap around, floating point sums are accumulated
+/// per vector lane so they can differ from a sequential sum in the last bits.
+template <contiguous_container TContainer>
+typename TContainer::value_type sum(const TContainer& container) {
+  return container.read([](auto values) { return detail::simd_sum(values); });
+}
+
+/// \brief Replaces every element with \p func(element).
+/// \details The loop runs over the raw buffer, so the compiler can vectorize simple functions.
+template <contiguous_container TContainer, typename TFunc>
+  requires std::invocable<TFunc&, typename TContainer::value_type>
+void transform_inplace(TContainer& container, TFunc&& func) {
+  container.write([&func](auto values) {
+    for (auto& value : values) {
+      value = func(value);
+    }
+  });
+}
+
+}  // namespace ccol
+
+#endif  // CONCURRENTCOLLECTIONS_ALGORITHM_H_
@@ -0,0 +1,262 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+
+#ifndef CONCURRENTCOLLECTIONS_ARENA_QUEUE_H_
+#define CONCURRENTCOLLECTIONS_ARENA_QUEUE_H_
+
+#include <ccol/common.h>
+#include <ccol/memory.h>
+#include <ccol/spinlock.h>
+
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+
+namespace ccol {
+
+/// \brief A double buffer queue for variable sized messages of different types.
+/// \details Writers append type tagged records (a small header followed by the payload) into a contiguous
+/// byte arena that acts as the back buffer. After swap_buffers() readers walk the records of the front arena
+/// in place, without copying. Arenas keep their storage when they are cleared, so once they have grown to
+/// the peak batch size pushing and swapping no longer allocate.
+class arena_queue final {
+ public:
+  using size_type = std::size_t;
+
+  /// \brief Records and their payloads start on this boundary.
+  static constexpr size_type record_alignment = 8;
+
+  struct record_header {
+    std::uint32_t type;
+    std::uint32_t size;
+  };
+
+  static_assert(sizeof(record_header) == record_alignment);
+
+  /// \brief The largest payload a record can hold, rounded down so the padded size still fits the header.
+  static constexpr size_type max_payload_size =
+      std::numeric_limits<std::uint32_t>::max() / record_alignment * record_alignment;
+
+  /// \brief A record in the front buffer.
+  struct record {
+    std::uint32_t type;
+    std::span<const std::byte> payload;
+
+    /// \brief Views the payload as a \p T that was pushed with push().
+    /// \throws std::length_error if the payload is smaller than \p T, so a mismatched type tag can't read past
+    /// the record, in release builds too.
+    template <typename T>
+    [[nodiscard]] const T& as() const {
+      static_assert(std::is_trivially_copyable_v<T>, "Arena queue messages must be trivially copyable");
+      static_assert(alignof(T) <= record_alignment, "Arena queue messages can't be over-aligned");
+      if (payload.size() < sizeof(T)) {
+        throw std::length_error("arena_queue record is smaller than the requested type");
+      }
+      return *std::launder(reinterpret_cast<const T*>(payload.data()));
+    }
+  };
+
+  struct const_iterator {
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = record;
+    using pointer = const record*;
+    using reference = record;
+
+    explicit const_iterator(const std::byte* position_)
+        : position(position_) {}
+
+    value_type operator*() const {
+      record_header header;
+      std::memcpy(&header, position, sizeof(header));
+      return {header.type, std::span<const std::byte>(position + sizeof(header), header.size)};
+    }
+
+    const_iterator operator++(int) {
+      const_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    const_iterator& operator++() {
+      record_header header;
+      std::memcpy(&header, position, sizeof(header));
+      position += record_bytes(header.size);
+      return *this;
+    }
+
+    bool equals(const const_iterator& other) const { return position == other.position; }
+    bool operator==(const const_iterator& other) const { return equals(other); };
+    bool operator!=(const const_iterator& other) const { return !equals(other); };
+
+    const std::byte* position = nullptr;
+  };
+
+  using iterator = const_iterator;
+
+  arena_queue() = default;
+  /// \brief Creates a queue whose arenas start with room for \p initial_bytes bytes of records.
+  explicit arena_queue(size_type initial_bytes) {
+    for (arena& buffer : buffers_) {
+      buffer.reserve(initial_bytes);
+    }
+  }
+
+  arena_queue(const arena_queue&) = delete;
+  arena_queue(arena_queue&&) = delete;
+  arena_queue& operator=(const arena_queue&) = delete;
+  arena_queue& operator=(arena_queue&&) = delete;
+  ~arena_queue() = default;
+
+  /// \brief Safely push a trivially copyable message to the back buffer.
+  template <typename T>
+  void push(std::uint32_t type, const T& message) {
+    static_assert(std::is_trivially_copyable_v<T>, "Arena queue messages must be trivially copyable");
+    static_assert(alignof(T) <= record_alignment, "Arena queue messages can't be over-aligned");
+    emplace(type, sizeof(T), [&message](std::span<std::byte> payload) {
+      std::memcpy(payload.data(), &message, sizeof(T));
+    });
+  }
+
+  /// \brief Safely push a message made of raw bytes to the back buffer.
+  void push(std::uint32_t type, std::span<const std::byte> payload) {
+    emplace(type, payload.size(), [payload](std::span<std::byte> destination) {
+      std::memcpy(destination.data(), payload.data(), payload.size());
+    });
+  }
+
+  /// \brief Safely reserve a record of \p size bytes in the back buffer and let \p writer fill it in place.
+  /// \details \p writer runs while the back buffer is locked, so it should only write the payload.
+  /// \throws std::length_error if \p size doesn't fit the 32-bit size of the record header.
+  template <typename TWriter>
+    requires std::invocable<TWriter&, std::span<std::byte>>
+  void emplace(std::uint32_t type, size_type size, TWriter&& writer) {
+    if (size > max_payload_size) {
+      throw std::length_error("arena_queue payload is too large");
+    }
+
+    std::lock_guard _scoped_lock(back_buffer_mutex_);
+    arena& back_buffer = buffers_[front_buffer_.load() ^ 1];
+    std::byte* position = back_buffer.allocate(record_bytes(size));
+
+    const record_header header{type, static_cast<std::uint32_t>(size)};
+    std::memcpy(position, &header, sizeof(header));
+    writer(std::span<std::byte>(position + sizeof(header), size));
+    back_buffer.count++;
+  }
+
+  /// \brief Check if back buffer has records before swapping
+  bool is_back_buffer_empty() const {
+    std::lock_guard _scoped_lock(back_buffer_mutex_);
+    return buffers_[front_buffer_.load() ^ 1].count == 0;
+  }
+
+  /// \brief Safely swap buffers (will wait for readers and writers)
+  void swap_buffers() {
+    std::scoped_lock _scoped_lock(back_buffer_mutex_, front_buffer_mutex_);
+    const std::uint8_t last_active_buffer = front_buffer_.fetch_xor(1);
+    buffers_[last_active_buffer].clear();
+  }
+
+  /// \brief Frees the back buffer storage beyond what its records use.
+  void shrink_to_fit() {
+    std::lock_guard _scoped_lock(back_buffer_mutex_);
+    buffers_[front_buffer_.load() ^ 1].shrink_to_fit();
+  }
+
+  /// \brief Bytes held by both arenas.
+  [[nodiscard]] size_type memory_bytes() const {
+    std::lock_guard _scoped_lock(back_buffer_mutex_);
+    return buffers_[0].capacity + buffers_[1].capacity;
+  }
+
+  /// \brief Get the number of records in the front buffer
+  size_type size() const { return buffers_[front_buffer_.load()].count; }
+  /// \brief Get the number of bytes the front buffer records take, headers and padding included.
+  size_type size_bytes() const { return buffers_[front_buffer_.load()].size; }
+  /// \brief Marks the front buffer as being read. You need to call unlock() when done.
+  void lock() const { front_buffer_mutex_.lock_shared(); }
+  /// \brief Unlocks the front buffer from reading.
+  void unlock() const { front_buffer_mutex_.unlock_shared(); }
+  [[nodiscard]] const_iterator begin() const { return const_iterator(buffers_[front_buffer_.load()].data); }
+  [[nodiscard]] const_iterator end() const {
+    const arena& front = buffers_[front_buffer_.load()];
+    return const_iterator(front.data + front.size);
+  }
+  /// \brief Checks if the front buffer has any records.
+  bool empty() const { return size() == 0; }
+
+ private:
+  static constexpr size_type record_bytes(size_type payload_size) {
+    return sizeof(record_header) + (payload_size + record_alignment - 1) / record_alignment * record_alignment;
+  }
+
+  /// \brief A growable block of bytes that keeps its storage when cleared.
+  struct arena {
+    arena() = default;
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+    ~arena() { detail::deallocate_array(data, capacity); }
+
+    void reserve(size_type new_capacity) {
+      if (new_capacity <= capacity) {
+        return;
+      }
+
+      // new[] of bytes is aligned for any fundamental type, which covers record_alignment
+      std::byte* new_data = detail::allocate_array<std::byte>(new_capacity);
+      if (size > 0) {
+        std::memcpy(new_data, data, size);
+      }
+      detail::deallocate_array(data, capacity);
+      data = new_data;
+      capacity = new_capacity;
+    }
+
+    std::byte* allocate(size_type bytes) {
+      if (size + bytes > capacity) {
+        reserve(std::max(size + bytes, capacity == 0 ? size_type{256} : capacity * 2));
+      }
+
+      std::byte* position = data + size;
+      size += bytes;
+      return position;
+    }
+
+    void clear() {
+      size = 0;
+      count = 0;
+    }
+
+    void shrink_to_fit() {
+      if (size == capacity) {
+        return;
+      }
+
+      std::byte* new_data = size > 0 ? detail::allocate_array<std::byte>(size) : nullptr;
+      if (size > 0) {
+        std::memcpy(new_data, data, size);
+      }
+      detail::deallocate_array(data, capacity);
+      data = new_data;
+      capacity = size;
+    }
+
+    std::byte* data = nullptr;
+    size_type size = 0;
+    size_type capacity = 0;
+    size_type count = 0;
+  };
+
+  std::array<arena, 2> buffers_;
+  mutable spin_mutex back_buffer_mutex_;
+  mutable shared_spin_mutex front_buffer_mutex_;
+  std::atomic<std::uint8_t> front_buffer_;
+};
+
+}  // namespace ccol
+
+#endif  // CONCURRENTCOLLECTIONS_ARENA_QUEUE_H_
@@ -0,0 +1,457 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+
+#ifndef CONCURRENTCOLLECTIONS_BATCH_LOG_H_
+#define CONCURRENTCOLLECTIONS_BATCH_LOG_H_
+
+#include <ccol/common.h>
+#include <ccol/double_buffer_queue.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <stop_token>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ccol {
+
+/// \brief Every header and payload in a batch log starts on this boundary so a mapped log can be read in place.
+inline constexpr std::size_t batch_log_alignment = 16;
+inline constexpr std::array<char, 8> batch_log_magic{'C', 'C', 'O', 'L', 'B', 'L', 'O', 'G'};
+inline constexpr std::uint32_t batch_log_version = 1;
+
+/// \brief Written once at the start of a batch log file.
+struct batch_log_file_header {
+  std::array<char, 8> magic = batch_log_magic;
+  std::uint32_t version = batch_log_version;
+  std::uint32_t element_size = 0;
+};
+
+/// \brief Written in front of every recorded batch, followed by \p count elements padded to the log alignment.
+struct batch_log_record_header {
+  std::uint64_t timestamp_ns = 0;
+  std::uint64_t count = 0;
+};
+
+static_assert(sizeof(batch_log_file_header) == batch_log_alignment);
+static_assert(sizeof(batch_log_record_header) == batch_log_alignment);
+
+/// \brief How fast batch_log_reader::replay() pushes batches back into a queue.
+enum class replay_speed : std::uint8_t {
+  original_rate,
+  full_speed,
+};
+
+namespace detail {
+
+constexpr std::size_t batch_log_padded(std::size_t bytes) {
+  return (bytes + batch_log_alignment - 1) / batch_log_alignment * batch_log_alignment;
+}
+
+/// \brief Read-only memory mapping of a whole file.
+class mapped_file final {
+ public:
+  explicit mapped_file(const std::filesystem::path& path) {
+#if defined(_WIN32)
+    file_ = CreateFileW(
+        path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+    );
+    if (file_ == INVALID_HANDLE_VALUE) {
+      return;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_, &file_size) || file_size.QuadPart == 0) {
+      return;
+    }
+
+    mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ == nullptr) {
+      return;
+    }
+
+    data_ = static_cast<const std::byte*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    size_ = data_ != nullptr ? static_cast<std::size_t>(file_size.QuadPart) : 0;
+#else
+    file_ = ::open(path.c_str(), O_RDONLY);
+    if (file_ < 0) {
+      return;
+    }
+
+    struct stat file_stat {};
+    if (::fstat(file_, &file_stat) != 0 || file_stat.st_size == 0) {
+      return;
+    }
+
+    void* data = ::mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file_, 0);
+    if (data == MAP_FAILED) {
+      return;
+    }
+
+    ::madvise(data, static_cast<std::size_t>(file_stat.st_size), MADV_SEQUENTIAL);
+    data_ = static_cast<const std::byte*>(data);
+    size_ = static_cast<std::size_t>(file_stat.st_size);
+#endif
+  }
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  ~mapped_file() {
+#if defined(_WIN32)
+    if (data_ != nullptr) {
+      UnmapViewOfFile(data_);
+    }
+    if (mapping_ != nullptr) {
+      CloseHandle(mapping_);
+    }
+    if (file_ != INVALID_HANDLE_VALUE) {
+      CloseHandle(file_);
+    }
+#else
+    if (data_ != nullptr) {
+      ::munmap(const_cast<std::byte*>(data_), size_);
+    }
+    if (file_ >= 0) {
+      ::close(file_);
+    }
+#endif
+  }
+
+  [[nodiscard]] const std::byte* data() const { return data_; }
+  [[nodiscard]] std::size_t size() const { return size_; }
+
+ private:
+#if defined(_WIN32)
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+#else
+  int file_ = -1;
+#endif
+  const std::byte* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+}  // namespace detail
+
+/// \brief Records batches of trivially copyable elements to a binary log file.
+/// \details Recording only copies the batch into an in-memory staging buffer. A background thread swaps the
+/// staging buffers and writes them out in large sequential writes, so the caller never waits on I/O.
+/// Typical use is recording every batch a double_buffer_queue produces:
+/// \code
+/// queue.swap_buffers([&recorder](const auto& front) { recorder.record(front); });
+/// \endcode
+template <typename T>
+class batch_log_writer final {
+ public:
+  static_assert(std::is_trivially_copyable_v<T>, "Batch logs can only contain trivial elements");
+  static_assert(alignof(T) <= batch_log_alignment, "Batch log elements can't be over-aligned");
+
+  using value_type = T;
+  using size_type = std::size_t;
+
+  /// \param path File to create, it is truncated if it exists.
+  /// \param flush_threshold Staged bytes after which the writer thread is woken up early.
+  explicit batch_log_writer(const std::filesystem::path& path, size_type flush_threshold = 1 << 20)
+      : flush_threshold_(flush_threshold), start_(std::chrono::steady_clock::now()) {
+#if defined(_WIN32)
+    file_ = _wfopen(path.c_str(), L"wb");
+#else
+    file_ = std::fopen(path.c_str(), "wb");
+#endif
+    if (file_ == nullptr) {
+      return;
+    }
+
+    const batch_log_file_header header{.element_size = static_cast<std::uint32_t>(sizeof(value_type))};
+    if (std::fwrite(&header, sizeof(header), 1, file_) != 1) {
+      failed_.store(true);
+      return;
+    }
+
+    for (auto& staging : staging_) {
+      staging.reserve(flush_threshold_ * 2);
+    }
+
+    writer_ = std::jthread([this](std::stop_token stop_token) { write_loop(stop_token); });
+  }
+
+  batch_log_writer(const batch_log_writer&) = delete;
+  batch_log_writer(batch_log_writer&&) = delete;
+  batch_log_writer& operator=(const batch_log_writer&) = delete;
+  batch_log_writer& operator=(batch_log_writer&&) = delete;
+
+  ~batch_log_writer() {
+    if (writer_.joinable()) {
+      writer_.request_stop();
+      writer_.join();
+    }
+
+    if (file_ != nullptr) {
+      flush();
+      std::fclose(file_);
+    }
+  }
+
+  [[nodiscard]] bool is_open() const { return file_ != nullptr; }
+  /// \brief Checks that the file is open and every write so far succeeded.
+  /// \details Write errors are sticky, once a write failed (a full disk for example) the log is truncated
+  /// and later records are dropped.
+  [[nodiscard]] bool good() const { return is_open() && !failed_.load(); }
+
+  /// \brief Stages a copy of \p batch to be written by the background thread.
+  void record(const trivial_vector<value_type>& batch) {
+    if (!good()) {
+      return;
+    }
+
+    std::unique_lock _scoped_lock(staging_mutex_);
+    std::byte* payload = stage_record(batch.size());
+    const size_type copied = batch.copy_to(reinterpret_cast<value_type*>(payload), batch.size());
+    finish_record(_scoped_lock, copied);
+  }
+
+  /// \brief Stages a copy of \p batch to be written by the background thread.
+  void record(std::span<const value_type> batch) {
+    if (!good()) {
+      return;
+    }
+
+    std::unique_lock _scoped_lock(staging_mutex_);
+    std::byte* payload = stage_record(batch.size());
+    std::memcpy(payload, batch.data(), batch.size_bytes());
+    finish_record(_scoped_lock, batch.size());
+  }
+
+  /// \brief Writes everything recorded so far to the file. Blocks on I/O.
+  void flush() {
+    std::lock_guard _file_lock(file_mutex_);
+    write_staged();
+    if (std::fflush(file_) != 0) {
+      failed_.store(true);
+    }
+  }
+
+ private:
+  /// \brief Reserves space for a record of \p count elements and returns where the payload goes.
+  std::byte* stage_record(size_type count) {
+    auto& staging = staging_[active_staging_];
+    record_offset_ = staging.size();
+    staging.resize(record_offset_ + sizeof(batch_log_record_header) + detail::batch_log_padded(count * sizeof(T)));
+    return staging.data() + record_offset_ + sizeof(batch_log_record_header);
+  }
+
+  /// \brief Writes the record header once the payload is in place and wakes the writer if enough is staged.
+  void finish_record(std::unique_lock<std::mutex>& staging_lock, size_type count) {
+    auto& staging = staging_[active_staging_];
+    const batch_log_record_header header{
+        .timestamp_ns = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count()
+        ),
+        .count = count,
+    };
+    std::memcpy(staging.data() + record_offset_, &header, sizeof(header));
+    staging.resize(record_offset_ + sizeof(header) + detail::batch_log_padded(count * sizeof(T)));
+
+    const bool should_wake = staging.size() >= flush_threshold_;
+    staging_lock.unlock();
+    if (should_wake) {
+      staging_ready_.notify_one();
+    }
+  }
+
+  /// \brief Swaps the staging buffers and writes out the inactive one. Needs file_mutex_.
+  void write_staged() {
+    std::vector<std::byte>* to_write = nullptr;
+    {
+      std::lock_guard _scoped_lock(staging_mutex_);
+      to_write = &staging_[active_staging_];
+      active_staging_ ^= 1;
+    }
+
+    if (!to_write->empty()) {
+      if (!failed_.load() && std::fwrite(to_write->data(), 1, to_write->size(), file_) != to_write->size()) {
+        failed_.store(true);
+      }
+      to_write->clear();
+    }
+  }
+
+  void write_loop(std::stop_token stop_token) {
+    while (!stop_token.stop_requested()) {
+      {
+        std::unique_lock _scoped_lock(staging_mutex_);
+        staging_ready_.wait_for(_scoped_lock, stop_token, std::chrono::milliseconds(10), [this] {
+          return staging_[active_staging_].size() >= flush_threshold_;
+        });
+      }
+
+      std::lock_guard _file_lock(file_mutex_);
+      write_staged();
+    }
+  }
+
+  std::FILE* file_ = nullptr;
+  std::atomic<bool> failed_ = false;
+  size_type flush_threshold_;
+  std::chrono::steady_clock::time_point start_;
+  std::array<std::vector<std::byte>, 2> staging_;
+  std::uint8_t active_staging_ = 0;
+  size_type record_offset_ = 0;
+  std::mutex staging_mutex_;
+  std::mutex file_mutex_;
+  std::condition_variable_any staging_ready_;
+  std::jthread writer_;
+};
+
+/// \brief Reads a log written by batch_log_writer through a read-only memory mapping.
+/// \details Batches are exposed in place as spans over the mapping, nothing is copied until they are replayed.
+/// A log that was cut short (e.g. the recording process crashed) ends at its last complete batch.
+template <typename T>
+class batch_log_reader final {
+ public:
+  static_assert(std::is_trivially_copyable_v<T>, "Batch logs can only contain trivial elements");
+  static_assert(alignof(T) <= batch_log_alignment, "Batch log elements can't be over-aligned");
+
+  using value_type = T;
+  using size_type = std::size_t;
+
+  struct batch {
+    std::chrono::nanoseconds timestamp;
+    std::span<const value_type> elements;
+  };
+
+  struct iterator {
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = batch;
+    using pointer = const batch*;
+    using reference = const batch&;
+
+    explicit iterator(const batch_log_reader& reader_, size_type offset_)
+        : offset(offset_), reader(&reader_) {}
+
+    value_type operator*() const { return reader->batch_at(offset); }
+
+    iterator operator++(int) {
+      iterator tmp = *this;
+      offset = reader->next_offset(offset);
+      return tmp;
+    }
+
+    iterator& operator++() {
+      offset = reader->next_offset(offset);
+      return *this;
+    }
+
+    bool equals(const iterator& other) const { return reader == other.reader && offset == other.offset; }
+    bool operator==(const iterator& other) const { return equals(other); };
+    bool operator!=(const iterator& other) const { return !equals(other); };
+
+    size_type offset = 0;
+    const batch_log_reader* reader;
+  };
+
+  using const_iterator = iterator;
+
+  explicit batch_log_reader(const std::filesystem::path& path)
+      : file_(path) {
+    if (file_.size() < sizeof(batch_log_file_header)) {
+      return;
+    }
+
+    batch_log_file_header header;
+    std::memcpy(&header, file_.data(), sizeof(header));
+    valid_ = header.magic == batch_log_magic && header.version == batch_log_version
+          && header.element_size == sizeof(value_type);
+  }
+
+  batch_log_reader(const batch_log_reader&) = delete;
+  batch_log_reader& operator=(const batch_log_reader&) = delete;
+
+  /// \brief Checks that the file could be mapped and was recorded with the same element size.
+  [[nodiscard]] bool is_open() const { return valid_; }
+
+  [[nodiscard]] iterator begin() const {
+    return iterator(*this, valid_ && is_complete_at(first_offset()) ? first_offset() : end_offset());
+  }
+  [[nodiscard]] iterator end() const { return iterator(*this, end_offset()); }
+
+  /// \brief Pushes every batch back into \p queue, optionally waiting to reproduce the recorded timing.
+  /// \details Each batch is appended with a single lock acquisition. Batch boundaries are preserved as long as
+  /// the consumer swaps between batches, which is what happens when it keeps up with the recorded rate.
+  /// The timing is relative to the first batch, the time the recorder sat idle before it is skipped.
+  void replay(double_buffer_queue<value_type>& queue, replay_speed speed = replay_speed::original_rate) const {
+    const auto start = std::chrono::steady_clock::now();
+    std::optional<std::chrono::nanoseconds> first_timestamp;
+    for (const batch& recorded : *this) {
+      if (speed == replay_speed::original_rate) {
+        first_timestamp = first_timestamp.value_or(recorded.timestamp);
+        std::this_thread::sleep_until(start + (recorded.timestamp - *first_timestamp));
+      }
+
+      queue.append(recorded.elements);
+    }
+  }
+
+ private:
+  static constexpr size_type first_offset() { return sizeof(batch_log_file_header); }
+
+  [[nodiscard]] size_type end_offset() const { return file_.size(); }
+
+  [[nodiscard]] batch_log_record_header header_at(size_type offset) const {
+    batch_log_record_header header;
+    std::memcpy(&header, file_.data() + offset, sizeof(header));
+    return header;
+  }
+
+  [[nodiscard]] bool is_complete_at(size_type offset) const {
+    if (offset + sizeof(batch_log_record_header) > end_offset()) {
+      return false;
+    }
+
+    const batch_log_record_header header = header_at(offset);
+    const size_type payload_bytes = detail::batch_log_padded(header.count * sizeof(value_type));
+    return header.count <= end_offset() / sizeof(value_type)
+        && offset + sizeof(batch_log_record_header) + payload_bytes <= end_offset();
+  }
+
+  [[nodiscard]] batch batch_at(size_type offset) const {
+    const batch_log_record_header header = header_at(offset);
+    const auto* elements = reinterpret_cast<const value_type*>(file_.data() + offset + sizeof(header));
+    return {
+        std::chrono::nanoseconds(header.timestamp_ns),
+        std::span<const value_type>(elements, header.count),
+    };
+  }
+
+  [[nodiscard]] size_type next_offset(size_type offset) const {
+    const batch_log_record_header header = header_at(offset);
+    offset += sizeof(header) + detail::batch_log_padded(header.count * sizeof(value_type));
+    return is_complete_at(offset) ? offset : end_offset();
+  }
+
+  detail::mapped_file file_;
+  bool valid_ = false;
+};
+
+}  // namespace ccol
+
+#endif  // CONCURRENTCOLLECTIONS_BATCH_LOG_H_
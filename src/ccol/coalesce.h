@@ -0,0 +1,318 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+
+#ifndef CONCURRENTCOLLECTIONS_COALESCE_H_
+#define CONCURRENTCOLLECTIONS_COALESCE_H_
+
+#include <ccol/common.h>
+#include <ccol/trivial_vector.h>
+
+#include <barrier>
+#include <memory>
+#include <thread>
+
+namespace ccol {
+
+/// \brief Sorts a batch by key and merges the elements that share a key.
+/// \details Meant to run as the swap step of a double_buffer_queue so readers only ever see coalesced batches:
+/// \code
+/// auto stage = ccol::make_coalesce_stage<update>(
+///     [](const update& u) { return u.entity; },
+///     [](update& into, const update& newer) { into.value = newer.value; });
+/// queue.swap_buffers(stage);
+/// \endcode
+/// The sort is an LSD radix sort over the integral key, one byte per pass, and it is stable, so \p merge sees
+/// duplicates in the order they were pushed. Passes where every key has the same byte are skipped.
+/// Batches of at least \p parallel_threshold elements are sorted by several threads that each histogram
+/// and scatter their own slice. The helper threads are started on the first parallel sort and then sleep on a
+/// barrier between batches, so the swap never spawns threads. The scratch buffer is kept between calls too,
+/// so the steady state doesn't allocate.
+/// The stage runs inside swap_buffers() with the queue locked, so producers wait for the whole sort; pick
+/// \p thread_count and \p parallel_threshold with that in mind.
+template <typename T, typename TKeyFunc, typename TMergeFunc>
+class coalesce_stage final {
+ public:
+  static_assert(std::is_trivially_copyable_v<T>, "Coalescing needs trivial elements");
+
+  using value_type = T;
+  using size_type = std::size_t;
+  using key_type = std::remove_cvref_t<std::invoke_result_t<TKeyFunc&, const T&>>;
+
+  static_assert(std::is_integral_v<key_type>, "Coalescing keys must be integral");
+  static_assert(std::is_invocable_v<TMergeFunc&, T&, const T&>, "Merge is called as merge(into, newer)");
+
+  static constexpr size_type default_parallel_threshold = 1 << 16;
+
+  coalesce_stage(
+      TKeyFunc key,
+      TMergeFunc merge,
+      std::uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency()),
+      size_type parallel_threshold = default_parallel_threshold
+  )
+      : key_(std::move(key))
+      , merge_(std::move(merge))
+      , thread_count_(std::max(1u, thread_count))
+      , parallel_threshold_(parallel_threshold) {}
+
+  /// \brief Coalesces \p batch in place and shrinks it to the merged size.
+  void operator()(trivial_vector<value_type>& batch) {
+    const size_type merged_size = batch.write([this](std::span<value_type> values) { return coalesce(values); });
+    batch.resize(merged_size);
+  }
+
+  /// \brief Coalesces \p values in place.
+  /// \returns The number of elements left at the front of \p values.
+  size_type coalesce(std::span<value_type> values) {
+    if (values.size() < 2) {
+      return values.size();
+    }
+
+    sort(values);
+
+    size_type last = 0;
+    for (size_type i = 1; i < values.size(); i++) {
+      if (key_(values[i]) == key_(values[last])) {
+        merge_(values[last], values[i]);
+      } else {
+        values[++last] = values[i];
+      }
+    }
+    return last + 1;
+  }
+
+ private:
+  using radix_type = std::make_unsigned_t<key_type>;
+  static constexpr size_type radix_bits = 8;
+  static constexpr size_type bucket_count = size_type{1} << radix_bits;
+  static constexpr size_type pass_count = sizeof(key_type);
+  using histogram = std::array<size_type, bucket_count>;
+
+  /// \brief Maps keys to unsigned values with the same order, flipping the sign bit of signed keys.
+  [[nodiscard]] radix_type radix_of(const value_type& value) const {
+    const auto key = static_cast<radix_type>(key_(value));
+    if constexpr (std::is_signed_v<key_type>) {
+      return key ^ (radix_type{1} << (sizeof(radix_type) * 8 - 1));
+    } else {
+      return key;
+    }
+  }
+
+  [[nodiscard]] size_type digit_of(const value_type& value, size_type pass) const {
+    return static_cast<size_type>((radix_of(value) >> (pass * radix_bits)) & (bucket_count - 1));
+  }
+
+  void sort(std::span<value_type> values) {
+    if (scratch_.size() < values.size()) {
+      scratch_.resize(values.size());
+    }
+
+    const std::uint32_t workers = values.size() >= parallel_threshold_ ? thread_count_ : 1;
+    histograms_.assign(workers, histogram{});
+    offsets_.resize(workers);
+    bool sorted_in_scratch = false;
+
+    if (workers == 1) {
+      value_type* source = values.data();
+      value_type* destination = scratch_.data();
+      for (size_type pass = 0; pass < pass_count; pass++) {
+        build_histogram(source, 0, values.size(), pass, histograms_[0]);
+        if (!is_pass_needed(values.size())) {
+          continue;
+        }
+
+        compute_offsets(0);
+        scatter(source, destination, 0, values.size(), pass, offsets_[0]);
+        std::swap(source, destination);
+        sorted_in_scratch = !sorted_in_scratch;
+      }
+    } else {
+      if (pool_ == nullptr) {
+        pool_ = std::make_unique<worker_pool>(workers);
+      }
+      sorted_in_scratch = pool_->run(*this, values);
+    }
+
+    if (sorted_in_scratch) {
+      std::copy(scratch_.begin(), scratch_.begin() + static_cast<std::ptrdiff_t>(values.size()), values.begin());
+    }
+  }
+
+  /// \brief One worker of the parallel sort, every worker runs all passes over its own slice.
+  /// \returns True if the result ended up in the scratch buffer.
+  bool sort_slice(
+      std::span<value_type> values,
+      std::uint32_t worker,
+      std::uint32_t workers,
+      std::barrier<>& sync_point
+  ) {
+    const size_type slice = (values.size() + workers - 1) / workers;
+    const size_type first = std::min(values.size(), slice * worker);
+    const size_type last = std::min(values.size(), first + slice);
+
+    value_type* source = values.data();
+    value_type* destination = scratch_.data();
+    bool sorted_in_scratch = false;
+    for (size_type pass = 0; pass < pass_count; pass++) {
+      build_histogram(source, first, last, pass, histograms_[worker]);
+      sync_point.arrive_and_wait();
+
+      // every worker sees the same histograms, so they all agree on skipping
+      const bool needed = is_pass_needed(values.size());
+      if (needed) {
+        compute_offsets(worker);
+        scatter(source, destination, first, last, pass, offsets_[worker]);
+      }
+      sync_point.arrive_and_wait();
+
+      if (needed) {
+        std::swap(source, destination);
+        sorted_in_scratch = !sorted_in_scratch;
+      }
+    }
+    return sorted_in_scratch;
+  }
+
+  /// \brief Helper threads for the parallel sort that wait on a barrier between batches.
+  /// \details Lives on the heap so the stage stays movable, the stage passes itself in with every batch.
+  struct worker_pool {
+    explicit worker_pool(std::uint32_t workers_)
+        : workers(workers_)
+        , start(static_cast<std::ptrdiff_t>(workers_))
+        , sync_point(static_cast<std::ptrdiff_t>(workers_))
+        , done(static_cast<std::ptrdiff_t>(workers_)) {
+      threads.reserve(workers - 1);
+      for (std::uint32_t worker = 1; worker < workers; worker++) {
+        threads.emplace_back([this, worker] { work(worker); });
+      }
+    }
+
+    worker_pool(const worker_pool&) = delete;
+    worker_pool& operator=(const worker_pool&) = delete;
+
+    ~worker_pool() {
+      stopping = true;
+      start.arrive_and_wait();
+      threads.clear();
+    }
+
+    /// \brief Sorts \p values with every worker, the calling thread being worker 0.
+    bool run(coalesce_stage& owner, std::span<value_type> values) {
+      stage = &owner;
+      batch = values;
+      start.arrive_and_wait();
+      const bool sorted_in_scratch = stage->sort_slice(batch, 0, workers, sync_point);
+      done.arrive_and_wait();
+      return sorted_in_scratch;
+    }
+
+    void work(std::uint32_t worker) {
+      while (true) {
+        start.arrive_and_wait();
+        if (stopping) {
+          return;
+        }
+
+        stage->sort_slice(batch, worker, workers, sync_point);
+        done.arrive_and_wait();
+      }
+    }
+
+    std::uint32_t workers;
+    std::barrier<> start;
+    std::barrier<> sync_point;
+    std::barrier<> done;
+    // only written before start, the barrier publishes them to the workers
+    coalesce_stage* stage = nullptr;
+    std::span<value_type> batch;
+    bool stopping = false;
+    std::vector<std::jthread> threads;
+  };
+
+  void build_histogram(
+      const value_type* source,
+      size_type first,
+      size_type last,
+      size_type pass,
+      histogram& counts
+  ) const {
+    counts.fill(0);
+    for (size_type i = first; i < last; i++) {
+      counts[digit_of(source[i], pass)]++;
+    }
+  }
+
+  /// \brief A pass is useless when every element lands in the same bucket.
+  [[nodiscard]] bool is_pass_needed(size_type total) const {
+    for (size_type bucket = 0; bucket < bucket_count; bucket++) {
+      size_type in_bucket = 0;
+      for (const histogram& counts : histograms_) {
+        in_bucket += counts[bucket];
+      }
+      if (in_bucket == total) {
+        return false;
+      }
+      if (in_bucket != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// \brief Turns the histograms into the first output index of every bucket for \p worker's slice.
+  void compute_offsets(std::uint32_t worker) {
+    histogram& offsets = offsets_[worker];
+    size_type running = 0;
+    for (size_type bucket = 0; bucket < bucket_count; bucket++) {
+      size_type before_worker = 0;
+      size_type in_bucket = 0;
+      for (std::uint32_t other = 0; other < histograms_.size(); other++) {
+        if (other < worker) {
+          before_worker += histograms_[other][bucket];
+        }
+        in_bucket += histograms_[other][bucket];
+      }
+      offsets[bucket] = running + before_worker;
+      running += in_bucket;
+    }
+  }
+
+  void scatter(
+      const value_type* source,
+      value_type* destination,
+      size_type first,
+      size_type last,
+      size_type pass,
+      histogram& offsets
+  ) const {
+    for (size_type i = first; i < last; i++) {
+      destination[offsets[digit_of(source[i], pass)]++] = source[i];
+    }
+  }
+
+  TKeyFunc key_;
+  TMergeFunc merge_;
+  std::uint32_t thread_count_;
+  size_type parallel_threshold_;
+  std::vector<value_type> scratch_;
+  std::vector<histogram> histograms_;
+  std::vector<histogram> offsets_;
+  std::unique_ptr<worker_pool> pool_;
+};
+
+/// \brief Creates a coalesce_stage for elements of type \p T.
+template <typename T, typename TKeyFunc, typename TMergeFunc>
+coalesce_stage<T, std::decay_t<TKeyFunc>, std::decay_t<TMergeFunc>> make_coalesce_stage(
+    TKeyFunc&& key,
+    TMergeFunc&& merge,
+    std::uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency()),
+    std::size_t parallel_threshold = coalesce_stage<T, std::decay_t<TKeyFunc>, std::decay_t<TMergeFunc>>::
+        default_parallel_threshold
+) {
+  return {std::forward<TKeyFunc>(key), std::forward<TMergeFunc>(merge), thread_count, parallel_threshold};
+}
+
+}  // namespace ccol
+
+#endif  // CONCURRENTCOLLECTIONS_COALESCE_H_
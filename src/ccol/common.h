@@ -6,11 +6,15 @@
 #ifndef CONCURRENT_COLLECTIONS_COMMON_H_
 #define CONCURRENT_COLLECTIONS_COMMON_H_
 
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <concepts>
 #include <cstdint>
 #include <mutex>
 #include <shared_mutex>
+#include <span>
+#include <utility>
 #include <vector>
 
 #endif  // CONCURRENT_COLLECTIONS_COMMON_H_
@@ -11,8 +11,18 @@
 #include <ccol/trivial_vector.h>
 #include <ccol/sparse_vector.h>
 
+#include <coroutine>
+
 namespace ccol {
 
+/// \brief Something that coroutines suspended on a double_buffer_queue are resumed through.
+/// \details schedule() is called from whichever thread made the coroutine ready (a producer pushing or a consumer
+/// swapping) after the queue locks are released. It can resume the handle inline or hand it to an executor.
+template <typename TScheduler>
+concept queue_scheduler = requires(TScheduler& scheduler, std::coroutine_handle<> handle) {
+  scheduler.schedule(handle);
+};
+
 /// \brief A double buffer queue is a queue class that allows multiple writers to add to a back buffer
 /// and multiple readers to access a front read-only buffer
 template <typename T>
@@ -30,7 +40,19 @@ class double_buffer_queue final {
   using reverse_iterator = TCollection::reverse_iterator;
   using const_reverse_iterator = TCollection::const_reverse_iterator;
 
+  class read_guard;
+
+  template <queue_scheduler TScheduler>
+  class batch_awaiter;
+
+  template <queue_scheduler TScheduler>
+  class push_awaiter;
+
   double_buffer_queue() = default;
+  /// \brief Creates a queue whose back buffer holds at most \p back_buffer_capacity elements for
+  /// try_push_back() and push(). push_back() and append() ignore the capacity.
+  explicit double_buffer_queue(size_type back_buffer_capacity)
+      : capacity_(back_buffer_capacity) {}
   double_buffer_queue(const double_buffer_queue&) = delete;
   double_buffer_queue(double_buffer_queue&&) = delete;
   double_buffer_queue& operator=(const double_buffer_queue&) = delete;
@@ -39,8 +61,50 @@ class double_buffer_queue final {
 
   /// \brief Safely push back a value to the back buffer
   void push_back(TParam element) {
-    std::lock_guard _scoped_lock(back_buffer_mutex_);
-    buffers_[front_buffer_.load() ^ 1].push_back(element);
+    waiter* ready = nullptr;
+    {
+      std::lock_guard _scoped_lock(back_buffer_mutex_);
+      buffers_[front_buffer_.load() ^ 1].push_back(element);
+      ready = batch_waiters_.pop();
+    }
+    resume(ready);
+  }
+
+  /// \brief Safely push back a value to the back buffer if it is below capacity.
+  /// \returns False if the back buffer is full.
+  bool try_push_back(TParam element) {
+    waiter* ready = nullptr;
+    {
+      std::lock_guard _scoped_lock(back_buffer_mutex_);
+      if (is_back_buffer_full_no_lock()) {
+        return false;
+      }
+
+      buffers_[front_buffer_.load() ^ 1].push_back(element);
+      ready = batch_waiters_.pop();
+    }
+    resume(ready);
+    return true;
+  }
+
+  /// \brief Safely push back a range of values to the back buffer with a single lock acquisition
+  void append(std::span<const T> elements) {
+    waiter* ready = nullptr;
+    {
+      std::lock_guard _scoped_lock(back_buffer_mutex_);
+      if constexpr (std::is_trivially_copyable_v<T>) {
+        buffers_[front_buffer_.load() ^ 1].append(elements);
+      } else {
+        for (const T& element : elements) {
+          buffers_[front_buffer_.load() ^ 1].push_back(element);
+        }
+      }
+
+      if (!elements.empty()) {
+        ready = batch_waiters_.pop();
+      }
+    }
+    resume(ready);
   }
 
   /// \brief Check if back buffer has values before swapping
@@ -51,11 +115,69 @@ class double_buffer_queue final {
 
   /// \brief Safely swap buffers (will wait for readers and writers)
   void swap_buffers() {
-    std::scoped_lock _scoped_lock(back_buffer_mutex_, front_buffer_mutex_);
-    const std::uint8_t last_active_buffer = front_buffer_.fetch_xor(1);
-    buffers_[last_active_buffer].clear();
+    swap_buffers([](TCollection&) {});
+  }
+
+  /// \brief Safely swap buffers and hand the new front buffer to \p on_swap before any reader can see it.
+  /// \details \p on_swap is called with both locks held, so it should only do in-memory work (e.g. copy the
+  /// batch out to a recorder) and must not call back into the queue.
+  template <typename TOnSwap>
+    requires std::invocable<TOnSwap&, TCollection&>
+  void swap_buffers(TOnSwap&& on_swap) {
+    swap_buffers_then(on_swap, false);
+  }
+
+  /// \brief Awaits until the back buffer has values, then swaps and gives read access to the new front buffer.
+  /// \details The awaiting coroutine is resumed through \p scheduler by the producer that makes the back
+  /// buffer non-empty. The swap and the read access are taken in one step, so the next swap waits until the
+  /// batch is released and concurrent consumers each get their own batch. If several consumers race for the
+  /// same values the later ones can get an empty batch, but no value is lost or seen twice.
+  /// Nothing is allocated, the awaiter lives in the coroutine frame.
+  /// \warning The swap waits for every reader, so the awaiting coroutine must not hold a batch of this queue
+  /// itself: `batch = co_await queue.next_batch(scheduler)` with a live `batch` spins forever. Release the
+  /// previous batch first, or pass it to the overload below.
+  /// \code
+  /// auto batch = co_await queue.next_batch(scheduler);
+  /// for (auto value : batch) { ... }
+  /// \endcode
+  template <queue_scheduler TScheduler>
+  [[nodiscard]] batch_awaiter<TScheduler> next_batch(TScheduler& scheduler) {
+    return batch_awaiter<TScheduler>(*this, scheduler);
+  }
+
+  /// \brief Releases \p previous and awaits the next batch, for consumers that reuse one guard.
+  /// \code
+  /// auto batch = co_await queue.next_batch(scheduler);
+  /// while (...) {
+  ///   for (auto value : batch) { ... }
+  ///   batch = co_await queue.next_batch(scheduler, batch);
+  /// }
+  /// \endcode
+  template <queue_scheduler TScheduler>
+  [[nodiscard]] batch_awaiter<TScheduler> next_batch(TScheduler& scheduler, read_guard& previous) {
+    previous.release();
+    return batch_awaiter<TScheduler>(*this, scheduler);
+  }
+
+  /// \brief Awaits until the back buffer is below capacity and pushes \p element.
+  /// \details If the back buffer is full the coroutine is suspended and resumed through \p scheduler by the
+  /// next swap_buffers() that makes room, with \p element already pushed. Nothing is allocated.
+  template <queue_scheduler TScheduler>
+  [[nodiscard]] push_awaiter<TScheduler> push(TParam element, TScheduler& scheduler) {
+    return push_awaiter<TScheduler>(*this, element, scheduler);
+  }
+
+  /// \brief Frees the storage the back buffer holds beyond its current values.
+  /// \details Right after swap_buffers() the back buffer is empty, so this releases what the previous
+  /// front buffer grew to. Producers are blocked while it runs, readers are not.
+  void shrink_to_fit() {
+    std::lock_guard _scoped_lock(back_buffer_mutex_);
+    buffers_[front_buffer_.load() ^ 1].shrink_to_fit();
   }
 
+  /// \brief Bytes held by both buffers.
+  [[nodiscard]] size_type memory_bytes() const { return buffers_[0].memory_bytes() + buffers_[1].memory_bytes(); }
+
   /// \brief Get the front buffer size
   size_type size() const { return buffers_[front_buffer_.load()].size(); }
   /// \brief Marks the front buffer as being read. You need to call unlock() when done.
@@ -72,10 +194,235 @@ class double_buffer_queue final {
   bool empty() const { return buffers_[front_buffer_.load()].empty(); }
 
  private:
+  /// \brief Intrusive node for a suspended coroutine, embedded in the awaiters so waiting never allocates.
+  struct waiter {
+    waiter* next = nullptr;
+    std::coroutine_handle<> handle;
+    void (*schedule)(waiter&) = nullptr;
+    void (*push)(waiter&, TCollection&) = nullptr;
+  };
+
+  /// \brief FIFO of suspended coroutines, guarded by back_buffer_mutex_.
+  struct waiter_list {
+    [[nodiscard]] bool empty() const { return head == nullptr; }
+
+    void push(waiter* node) {
+      node->next = nullptr;
+      if (tail == nullptr) {
+        head = node;
+      } else {
+        tail->next = node;
+      }
+      tail = node;
+    }
+
+    waiter* pop() {
+      waiter* node = head;
+      if (node != nullptr) {
+        head = node->next;
+        if (head == nullptr) {
+          tail = nullptr;
+        }
+      }
+      return node;
+    }
+
+    waiter* head = nullptr;
+    waiter* tail = nullptr;
+  };
+
+  static void resume(waiter* ready) {
+    if (ready != nullptr) {
+      ready->schedule(*ready);
+    }
+  }
+
+  [[nodiscard]] bool is_back_buffer_full_no_lock() const {
+    return capacity_ != 0 && buffers_[front_buffer_.load() ^ 1].size() >= capacity_;
+  }
+
+  /// \brief Swaps the buffers, calls \p on_swap and wakes whoever can make progress.
+  /// \details With \p keep_read_lock the caller gets shared access to the new front buffer before the
+  /// exclusive lock is dropped and has to unlock() it.
+  template <typename TOnSwap>
+  void swap_buffers_then(TOnSwap& on_swap, bool keep_read_lock) {
+    waiter_list ready;
+    {
+      std::scoped_lock _scoped_lock(back_buffer_mutex_, front_buffer_mutex_);
+      const std::uint8_t last_active_buffer = front_buffer_.fetch_xor(1);
+      buffers_[last_active_buffer].clear();
+      on_swap(buffers_[last_active_buffer ^ 1]);
+
+      // The back buffer was emptied, let suspended producers in while there is room.
+      while (!push_waiters_.empty() && !is_back_buffer_full_no_lock()) {
+        waiter* producer = push_waiters_.pop();
+        producer->push(*producer, buffers_[last_active_buffer]);
+        ready.push(producer);
+      }
+
+      if (!ready.empty() && !batch_waiters_.empty()) {
+        ready.push(batch_waiters_.pop());
+      }
+
+      if (keep_read_lock) {
+        front_buffer_mutex_.lock_shared_while_exclusive();
+      }
+    }
+
+    while (!ready.empty()) {
+      resume(ready.pop());
+    }
+  }
+
+  /// \returns False if the back buffer already has values and the consumer shouldn't suspend.
+  bool suspend_for_batch(waiter& consumer) {
+    std::lock_guard _scoped_lock(back_buffer_mutex_);
+    if (!buffers_[front_buffer_.load() ^ 1].empty()) {
+      return false;
+    }
+
+    batch_waiters_.push(&consumer);
+    return true;
+  }
+
+  /// \returns False if the element was pushed right away and the producer shouldn't suspend.
+  bool suspend_for_push(waiter& producer) {
+    waiter* ready = nullptr;
+    {
+      std::lock_guard _scoped_lock(back_buffer_mutex_);
+      if (is_back_buffer_full_no_lock()) {
+        push_waiters_.push(&producer);
+        return true;
+      }
+
+      producer.push(producer, buffers_[front_buffer_.load() ^ 1]);
+      ready = batch_waiters_.pop();
+    }
+    resume(ready);
+    return false;
+  }
+
   std::array<TCollection, 2> buffers_;
   mutable spin_mutex back_buffer_mutex_;
   mutable shared_spin_mutex front_buffer_mutex_;
   std::atomic<std::uint8_t> front_buffer_;
+  size_type capacity_ = 0;
+  waiter_list batch_waiters_;
+  waiter_list push_waiters_;
+};
+
+/// \brief Shared read access to the front buffer that is released when the guard goes out of scope.
+template <typename T>
+class double_buffer_queue<T>::read_guard final {
+ public:
+  explicit read_guard(const double_buffer_queue& queue)
+      : queue_(&queue) {
+    queue_->lock();
+  }
+
+  /// \brief Takes over read access the caller already holds.
+  read_guard(const double_buffer_queue& queue, std::adopt_lock_t)
+      : queue_(&queue) {}
+
+  read_guard(read_guard&& other) noexcept
+      : queue_(std::exchange(other.queue_, nullptr)) {}
+
+  read_guard& operator=(read_guard&& other) noexcept {
+    if (this != &other) {
+      release();
+      queue_ = std::exchange(other.queue_, nullptr);
+    }
+    return *this;
+  }
+
+  read_guard(const read_guard&) = delete;
+  read_guard& operator=(const read_guard&) = delete;
+  ~read_guard() { release(); }
+
+  /// \brief Unlocks the front buffer early.
+  void release() {
+    if (queue_ != nullptr) {
+      queue_->unlock();
+      queue_ = nullptr;
+    }
+  }
+
+  [[nodiscard]] size_type size() const { return queue_->size(); }
+  [[nodiscard]] bool empty() const { return queue_->empty(); }
+  [[nodiscard]] const_iterator begin() const { return queue_->begin(); }
+  [[nodiscard]] const_iterator end() const { return queue_->end(); }
+  TParam operator[](size_type index) const { return (*queue_)[index]; }
+
+ private:
+  const double_buffer_queue* queue_;
+};
+
+/// \brief Returned by double_buffer_queue::next_batch().
+template <typename T>
+template <queue_scheduler TScheduler>
+class double_buffer_queue<T>::batch_awaiter final : waiter {
+ public:
+  batch_awaiter(double_buffer_queue& queue, TScheduler& scheduler)
+      : queue_(queue), scheduler_(scheduler) {
+    this->schedule = &schedule_through;
+  }
+
+  batch_awaiter(const batch_awaiter&) = delete;
+  batch_awaiter& operator=(const batch_awaiter&) = delete;
+
+  [[nodiscard]] bool await_ready() const { return !queue_.is_back_buffer_empty(); }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    this->handle = handle;
+    return queue_.suspend_for_batch(*this);
+  }
+
+  [[nodiscard]] read_guard await_resume() {
+    constexpr auto noop = [](TCollection&) {};
+    queue_.swap_buffers_then(noop, true);
+    return read_guard(queue_, std::adopt_lock);
+  }
+
+ private:
+  static void schedule_through(waiter& node) { static_cast<batch_awaiter&>(node).scheduler_.schedule(node.handle); }
+
+  double_buffer_queue& queue_;
+  TScheduler& scheduler_;
+};
+
+/// \brief Returned by double_buffer_queue::push().
+template <typename T>
+template <queue_scheduler TScheduler>
+class double_buffer_queue<T>::push_awaiter final : waiter {
+ public:
+  push_awaiter(double_buffer_queue& queue, TParam element, TScheduler& scheduler)
+      : queue_(queue), scheduler_(scheduler), element_(element) {
+    this->schedule = &schedule_through;
+    this->push = &push_element;
+  }
+
+  push_awaiter(const push_awaiter&) = delete;
+  push_awaiter& operator=(const push_awaiter&) = delete;
+
+  [[nodiscard]] bool await_ready() { return queue_.try_push_back(element_); }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    this->handle = handle;
+    return queue_.suspend_for_push(*this);
+  }
+
+  void await_resume() const {}
+
+ private:
+  static void schedule_through(waiter& node) { static_cast<push_awaiter&>(node).scheduler_.schedule(node.handle); }
+
+  static void push_element(waiter& node, TCollection& back_buffer) {
+    back_buffer.push_back(static_cast<push_awaiter&>(node).element_);
+  }
+
+  double_buffer_queue& queue_;
+  TScheduler& scheduler_;
+  T element_;
 };
 
 }  // namespace ccol
@@ -0,0 +1,265 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+
+#ifndef CONCURRENTCOLLECTIONS_EPOCH_H_
+#define CONCURRENTCOLLECTIONS_EPOCH_H_
+
+#include <ccol/common.h>
+#include <ccol/spinlock.h>
+
+namespace ccol {
+
+/// \brief Epoch based memory reclamation shared by the containers.
+/// \details Readers pin the current epoch while they dereference shared storage, writers unlink storage and
+/// retire it instead of freeing it. Retired storage is freed once the global epoch has moved two steps past
+/// the one it was retired in, at which point no pinned reader can still hold a pointer to it.
+/// Pinning is a couple of atomic operations on a cache line owned by the thread, so readers never wait for
+/// writers and writers never wait for readers.
+/// \code
+/// {
+///   const ccol::epoch::guard _pinned;
+///   const T* buffer = shared_buffer.load();
+///   ... // buffer stays valid until the guard goes out of scope
+/// }
+/// T* old_buffer = shared_buffer.exchange(new_buffer);
+/// ccol::epoch::retire(old_buffer, [](void* buffer, std::size_t) { delete[] static_cast<T*>(buffer); });
+/// \endcode
+namespace epoch {
+
+/// \brief Frees retired storage, \p count is whatever was passed to retire().
+using deleter_type = void (*)(void* pointer, std::size_t count);
+
+namespace detail {
+
+/// \brief Per thread pin state. Records are never freed while the process runs, threads that exit hand
+/// theirs back so new threads can reuse them.
+struct alignas(64) thread_record {
+  static constexpr std::uint64_t quiescent = 0;
+
+  /// \brief The epoch the thread is pinned in, or quiescent.
+  std::atomic<std::uint64_t> state = quiescent;
+  std::atomic<bool> in_use = false;
+  thread_record* next = nullptr;
+  /// \brief Only touched by the owning thread.
+  std::uint32_t nesting = 0;
+  /// \brief Outermost unpins so far, only touched by the owning thread.
+  std::uint32_t unpins = 0;
+};
+
+class domain final {
+ public:
+  /// \brief Readers help collecting on every this many outermost unpins, writers collect on every retire.
+  static constexpr std::uint32_t reader_collect_interval = 64;
+
+  constexpr domain() = default;
+  domain(const domain&) = delete;
+  domain& operator=(const domain&) = delete;
+
+  /// \details Runs at static destruction, after every thread that could pin is gone.
+  ~domain() {
+    for (const retired& item : retired_) {
+      item.deleter(item.pointer, item.count);
+    }
+
+    thread_record* record = records_.load();
+    while (record != nullptr) {
+      thread_record* next = record->next;
+      delete record;
+      record = next;
+    }
+  }
+
+  thread_record* acquire_record() {
+    for (thread_record* record = records_.load(); record != nullptr; record = record->next) {
+      bool expected = false;
+      if (!record->in_use.load(std::memory_order_relaxed) && record->in_use.compare_exchange_strong(expected, true)) {
+        return record;
+      }
+    }
+
+    auto* record = new thread_record();
+    record->in_use.store(true);
+    record->next = records_.load();
+    while (!records_.compare_exchange_weak(record->next, record)) {
+    }
+    return record;
+  }
+
+  static void release_record(thread_record* record) {
+    record->state.store(thread_record::quiescent);
+    record->in_use.store(false, std::memory_order_release);
+  }
+
+  void pin(thread_record& record) {
+    if (record.nesting++ > 0) {
+      return;
+    }
+
+    // publish the epoch we saw and check it didn't move meanwhile, otherwise an advance could have missed us
+    std::uint64_t current = epoch_.load();
+    while (true) {
+      record.state.store(current);
+      const std::uint64_t now = epoch_.load();
+      if (now == current) {
+        break;
+      }
+      current = now;
+    }
+  }
+
+  void unpin(thread_record& record) {
+    if (--record.nesting > 0) {
+      return;
+    }
+
+    record.state.store(thread_record::quiescent, std::memory_order_release);
+    // readers help now and then, so storage retired by a writer that went idle is still freed, but a short
+    // lookup doesn't pay for scanning every record and never waits on a writer that is collecting
+    if (++record.unpins % reader_collect_interval == 0 && pending_.load(std::memory_order_relaxed) > 0) {
+      collect(false);
+    }
+  }
+
+  void retire(void* pointer, std::size_t count, deleter_type deleter) {
+    if (pointer == nullptr) {
+      return;
+    }
+
+    {
+      std::lock_guard _scoped_lock(retired_mutex_);
+      retired_.push_back({pointer, count, deleter, epoch_.load()});
+      pending_.store(retired_.size(), std::memory_order_relaxed);
+    }
+    collect(true);
+  }
+
+  /// \brief Advances the epoch as far as pinned threads allow and frees what is safe to free.
+  /// \returns The number of items freed.
+  std::size_t collect(bool wait_for_lock) {
+    try_advance();
+    try_advance();
+    const std::uint64_t current = epoch_.load();
+
+    std::vector<retired> ready;
+    {
+      std::unique_lock _scoped_lock(retired_mutex_, std::defer_lock);
+      if (wait_for_lock) {
+        _scoped_lock.lock();
+      } else if (!_scoped_lock.try_lock()) {
+        return 0;
+      }
+
+      const auto first_ready = std::stable_partition(retired_.begin(), retired_.end(), [current](const retired& item) {
+        return item.epoch + 2 > current;
+      });
+      ready.assign(first_ready, retired_.end());
+      retired_.erase(first_ready, retired_.end());
+      pending_.store(retired_.size(), std::memory_order_relaxed);
+    }
+
+    for (const retired& item : ready) {
+      item.deleter(item.pointer, item.count);
+    }
+    return ready.size();
+  }
+
+  [[nodiscard]] std::size_t pending() const { return pending_.load(std::memory_order_relaxed); }
+  [[nodiscard]] std::uint64_t current_epoch() const { return epoch_.load(); }
+
+ private:
+  struct retired {
+    void* pointer;
+    std::size_t count;
+    deleter_type deleter;
+    std::uint64_t epoch;
+  };
+
+  /// \brief Moves the epoch forward if every pinned thread has seen the current one.
+  bool try_advance() {
+    std::uint64_t current = epoch_.load();
+    for (thread_record* record = records_.load(); record != nullptr; record = record->next) {
+      const std::uint64_t state = record->state.load();
+      if (state != thread_record::quiescent && state != current) {
+        return false;
+      }
+    }
+    return epoch_.compare_exchange_strong(current, current + 1);
+  }
+
+  alignas(64) std::atomic<std::uint64_t> epoch_ = 1;
+  std::atomic<thread_record*> records_ = nullptr;
+  std::atomic<std::size_t> pending_ = 0;
+  spin_mutex retired_mutex_;
+  std::vector<retired> retired_;
+};
+
+inline constinit domain global_domain;
+
+/// \brief Registers the thread on first use and hands the record back when the thread exits.
+struct thread_registration {
+  thread_record* record = nullptr;
+
+  ~thread_registration() {
+    if (record != nullptr) {
+      domain::release_record(record);
+    }
+  }
+};
+
+inline thread_record& this_thread_record() {
+  thread_local thread_registration registration;
+  if (registration.record == nullptr) {
+    registration.record = global_domain.acquire_record();
+  }
+  return *registration.record;
+}
+
+}  // namespace detail
+
+/// \brief Pins the calling thread to the current epoch for its lifetime, nested guards are allowed.
+/// \details Storage retired while a guard is alive is not freed before the guard is destroyed.
+class guard final {
+ public:
+  guard()
+      : record_(detail::this_thread_record()) {
+    detail::global_domain.pin(record_);
+  }
+
+  guard(const guard&) = delete;
+  guard& operator=(const guard&) = delete;
+  ~guard() { detail::global_domain.unpin(record_); }
+
+ private:
+  detail::thread_record& record_;
+};
+
+/// \brief Hands \p pointer over to be freed with \p deleter once no pinned thread can reach it.
+/// \details Call it after \p pointer was unlinked, readers that pin afterwards must not be able to find it.
+/// Retiring while pinned is fine, the storage just outlives the guard.
+inline void retire(void* pointer, std::size_t count, deleter_type deleter) {
+  detail::global_domain.retire(pointer, count, deleter);
+}
+
+/// \brief Retires an object created with new.
+template <typename T>
+void retire(T* object) {
+  retire(object, 1, [](void* pointer, std::size_t) { delete static_cast<T*>(pointer); });
+}
+
+/// \brief Frees the retired storage that is safe to free.
+/// \returns The number of items freed.
+inline std::size_t collect() { return detail::global_domain.collect(true); }
+
+/// \brief Number of retired items that are waiting for readers to move on.
+inline std::size_t pending() { return detail::global_domain.pending(); }
+
+/// \brief Checks if the calling thread holds a guard.
+inline bool is_pinned() { return detail::this_thread_record().nesting > 0; }
+
+}  // namespace epoch
+
+}  // namespace ccol
+
+#endif  // CONCURRENTCOLLECTIONS_EPOCH_H_
@@ -0,0 +1,48 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+
+#ifndef CONCURRENTCOLLECTIONS_MEMORY_H_
+#define CONCURRENTCOLLECTIONS_MEMORY_H_
+
+#include <ccol/common.h>
+
+namespace ccol {
+
+namespace detail {
+
+inline std::atomic<std::size_t> allocated_bytes{0};
+
+inline void track_allocation(std::size_t bytes) { allocated_bytes.fetch_add(bytes, std::memory_order_relaxed); }
+inline void track_deallocation(std::size_t bytes) { allocated_bytes.fetch_sub(bytes, std::memory_order_relaxed); }
+
+/// \brief Allocates an array that is counted in ccol::allocated_bytes().
+template <typename T>
+T* allocate_array(std::size_t count) {
+  auto* array = new T[count];
+  track_allocation(count * sizeof(T));
+  return array;
+}
+
+/// \brief Frees an array created with allocate_array(). \p count must match the allocation.
+template <typename T>
+void deallocate_array(T* array, std::size_t count) {
+  if (array == nullptr) {
+    return;
+  }
+
+  delete[] array;
+  track_deallocation(count * sizeof(T));
+}
+
+}  // namespace detail
+
+/// \brief Bytes currently held by all ccol containers in the process.
+/// \details Counts element storage and page bookkeeping. The value is updated with relaxed atomics, so it is
+/// meant for monitoring and is only exact once the containers are quiescent.
+inline std::size_t allocated_bytes() { return detail::allocated_bytes.load(std::memory_order_relaxed); }
+
+}  // namespace ccol
+
+#endif  // CONCURRENTCOLLECTIONS_MEMORY_H_
@@ -0,0 +1,356 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+
+#ifndef CONCURRENTCOLLECTIONS_SIMD_H_
+#define CONCURRENTCOLLECTIONS_SIMD_H_
+
+#include <ccol/common.h>
+
+#include <bit>
+#include <limits>
+
+#if defined(__AVX2__)
+#define CCOL_SIMD_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#define CCOL_SIMD_SSE4_1 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+// every x86-64 compiler targets at least SSE2, so default builds without -m flags still get vector kernels
+#define CCOL_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define CCOL_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace ccol {
+
+/// \brief The instruction set the bulk kernels were compiled for.
+#if defined(CCOL_SIMD_AVX2)
+inline constexpr const char* simd_instruction_set = "avx2";
+#elif defined(CCOL_SIMD_SSE4_1)
+inline constexpr const char* simd_instruction_set = "sse4.1";
+#elif defined(CCOL_SIMD_SSE2)
+inline constexpr const char* simd_instruction_set = "sse2";
+#elif defined(CCOL_SIMD_NEON)
+inline constexpr const char* simd_instruction_set = "neon";
+#else
+inline constexpr const char* simd_instruction_set = "scalar";
+#endif
+
+namespace detail {
+
+/// \brief Vector operations for one element type on the instruction set picked at compile time.
+/// \details Left undefined for types without a vector path, the kernels fall back to scalar loops for those.
+template <typename T>
+struct simd_ops;
+
+#if defined(CCOL_SIMD_AVX2)
+
+template <typename T>
+struct avx2_int32_ops {
+  using reg = __m256i;
+  static constexpr std::size_t width = 8;
+
+  static reg load(const T* values) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values)); }
+  static reg broadcast(T value) { return _mm256_set1_epi32(static_cast<std::int32_t>(value)); }
+  static reg add(reg a, reg b) { return _mm256_add_epi32(a, b); }
+
+  static std::uint32_t equal_mask(reg a, reg b) {
+    return static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b))));
+  }
+
+  static void store(T* values, reg a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(values), a); }
+};
+
+template <>
+struct simd_ops<std::int32_t> : avx2_int32_ops<std::int32_t> {
+  static reg min(reg a, reg b) { return _mm256_min_epi32(a, b); }
+  static reg max(reg a, reg b) { return _mm256_max_epi32(a, b); }
+};
+
+template <>
+struct simd_ops<std::uint32_t> : avx2_int32_ops<std::uint32_t> {
+  static reg min(reg a, reg b) { return _mm256_min_epu32(a, b); }
+  static reg max(reg a, reg b) { return _mm256_max_epu32(a, b); }
+};
+
+template <>
+struct simd_ops<float> {
+  using reg = __m256;
+  static constexpr std::size_t width = 8;
+
+  static reg load(const float* values) { return _mm256_loadu_ps(values); }
+  static reg broadcast(float value) { return _mm256_set1_ps(value); }
+  static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+  static reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+  static reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+
+  static std::uint32_t equal_mask(reg a, reg b) {
+    return static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)));
+  }
+
+  static void store(float* values, reg a) { _mm256_storeu_ps(values, a); }
+};
+
+#elif defined(CCOL_SIMD_SSE4_1) || defined(CCOL_SIMD_SSE2)
+
+template <typename T>
+struct sse_int32_ops {
+  using reg = __m128i;
+  static constexpr std::size_t width = 4;
+
+  static reg load(const T* values) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(values)); }
+  static reg broadcast(T value) { return _mm_set1_epi32(static_cast<std::int32_t>(value)); }
+  static reg add(reg a, reg b) { return _mm_add_epi32(a, b); }
+
+  static std::uint32_t equal_mask(reg a, reg b) {
+    return static_cast<std::uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b))));
+  }
+
+  static void store(T* values, reg a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(values), a); }
+};
+
+#if defined(CCOL_SIMD_SSE4_1)
+
+template <>
+struct simd_ops<std::int32_t> : sse_int32_ops<std::int32_t> {
+  static reg min(reg a, reg b) { return _mm_min_epi32(a, b); }
+  static reg max(reg a, reg b) { return _mm_max_epi32(a, b); }
+};
+
+template <>
+struct simd_ops<std::uint32_t> : sse_int32_ops<std::uint32_t> {
+  static reg min(reg a, reg b) { return _mm_min_epu32(a, b); }
+  static reg max(reg a, reg b) { return _mm_max_epu32(a, b); }
+};
+
+#else
+
+/// \brief SSE2 has no 32-bit min and max, they are built from a compare and a select.
+inline __m128i sse2_select(__m128i mask, __m128i if_set, __m128i if_clear) {
+  return _mm_or_si128(_mm_and_si128(mask, if_set), _mm_andnot_si128(mask, if_clear));
+}
+
+template <>
+struct simd_ops<std::int32_t> : sse_int32_ops<std::int32_t> {
+  static reg min(reg a, reg b) { return sse2_select(_mm_cmpgt_epi32(a, b), b, a); }
+  static reg max(reg a, reg b) { return sse2_select(_mm_cmpgt_epi32(a, b), a, b); }
+};
+
+template <>
+struct simd_ops<std::uint32_t> : sse_int32_ops<std::uint32_t> {
+  // flipping the sign bit maps unsigned order onto the signed compare
+  static reg greater(reg a, reg b) {
+    const reg sign = _mm_set1_epi32(std::numeric_limits<std::int32_t>::min());
+    return _mm_cmpgt_epi32(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign));
+  }
+
+  static reg min(reg a, reg b) { return sse2_select(greater(a, b), b, a); }
+  static reg max(reg a, reg b) { return sse2_select(greater(a, b), a, b); }
+};
+
+#endif
+
+template <>
+struct simd_ops<float> {
+  using reg = __m128;
+  static constexpr std::size_t width = 4;
+
+  static reg load(const float* values) { return _mm_loadu_ps(values); }
+  static reg broadcast(float value) { return _mm_set1_ps(value); }
+  static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+  static reg min(reg a, reg b) { return _mm_min_ps(a, b); }
+  static reg max(reg a, reg b) { return _mm_max_ps(a, b); }
+
+  static std::uint32_t equal_mask(reg a, reg b) {
+    return static_cast<std::uint32_t>(_mm_movemask_ps(_mm_cmpeq_ps(a, b)));
+  }
+
+  static void store(float* values, reg a) { _mm_storeu_ps(values, a); }
+};
+
+#elif defined(CCOL_SIMD_NEON)
+
+/// \brief Packs a NEON lane mask into one bit per lane like movemask does on x86.
+inline std::uint32_t neon_lane_mask(uint32x4_t mask) {
+  constexpr std::uint32_t lane_bits[4] = {1, 2, 4, 8};
+  return vaddvq_u32(vandq_u32(mask, vld1q_u32(lane_bits)));
+}
+
+template <>
+struct simd_ops<std::int32_t> {
+  using reg = int32x4_t;
+  static constexpr std::size_t width = 4;
+
+  static reg load(const std::int32_t* values) { return vld1q_s32(values); }
+  static reg broadcast(std::int32_t value) { return vdupq_n_s32(value); }
+  static reg add(reg a, reg b) { return vaddq_s32(a, b); }
+  static reg min(reg a, reg b) { return vminq_s32(a, b); }
+  static reg max(reg a, reg b) { return vmaxq_s32(a, b); }
+  static std::uint32_t equal_mask(reg a, reg b) { return neon_lane_mask(vceqq_s32(a, b)); }
+  static void store(std::int32_t* values, reg a) { vst1q_s32(values, a); }
+};
+
+template <>
+struct simd_ops<std::uint32_t> {
+  using reg = uint32x4_t;
+  static constexpr std::size_t width = 4;
+
+  static reg load(const std::uint32_t* values) { return vld1q_u32(values); }
+  static reg broadcast(std::uint32_t value) { return vdupq_n_u32(value); }
+  static reg add(reg a, reg b) { return vaddq_u32(a, b); }
+  static reg min(reg a, reg b) { return vminq_u32(a, b); }
+  static reg max(reg a, reg b) { return vmaxq_u32(a, b); }
+  static std::uint32_t equal_mask(reg a, reg b) { return neon_lane_mask(vceqq_u32(a, b)); }
+  static void store(std::uint32_t* values, reg a) { vst1q_u32(values, a); }
+};
+
+template <>
+struct simd_ops<float> {
+  using reg = float32x4_t;
+  static constexpr std::size_t width = 4;
+
+  static reg load(const float* values) { return vld1q_f32(values); }
+  static reg broadcast(float value) { return vdupq_n_f32(value); }
+  static reg add(reg a, reg b) { return vaddq_f32(a, b); }
+  static reg min(reg a, reg b) { return vminq_f32(a, b); }
+  static reg max(reg a, reg b) { return vmaxq_f32(a, b); }
+  static std::uint32_t equal_mask(reg a, reg b) { return neon_lane_mask(vceqq_f32(a, b)); }
+  static void store(float* values, reg a) { vst1q_f32(values, a); }
+};
+
+#endif
+
+template <typename T>
+concept has_simd_ops = requires { simd_ops<T>::width; };
+
+/// \brief Reduces the lanes of \p reg with \p reduce.
+template <typename T, typename TReduce>
+T reduce_lanes(typename simd_ops<T>::reg reg, TReduce reduce) {
+  std::array<T, simd_ops<T>::width> lanes;
+  simd_ops<T>::store(lanes.data(), reg);
+  T result = lanes[0];
+  for (std::size_t i = 1; i < lanes.size(); i++) {
+    result = reduce(result, lanes[i]);
+  }
+  return result;
+}
+
+/// \returns The index of the first element equal to \p value or values.size() if there is none.
+template <typename T>
+std::size_t simd_find(std::span<const T> values, T value) {
+  std::size_t i = 0;
+  if constexpr (has_simd_ops<T>) {
+    using ops = simd_ops<T>;
+    const auto needle = ops::broadcast(value);
+    for (; i + ops::width <= values.size(); i += ops::width) {
+      const std::uint32_t mask = ops::equal_mask(ops::load(values.data() + i), needle);
+      if (mask != 0) {
+        return i + static_cast<std::size_t>(std::countr_zero(mask));
+      }
+    }
+  }
+
+  for (; i < values.size(); i++) {
+    if (values[i] == value) {
+      return i;
+    }
+  }
+  return values.size();
+}
+
+template <typename T>
+std::size_t simd_count(std::span<const T> values, T value) {
+  std::size_t i = 0;
+  std::size_t count = 0;
+  if constexpr (has_simd_ops<T>) {
+    using ops = simd_ops<T>;
+    const auto needle = ops::broadcast(value);
+    for (; i + ops::width <= values.size(); i += ops::width) {
+      count += static_cast<std::size_t>(std::popcount(ops::equal_mask(ops::load(values.data() + i), needle)));
+    }
+  }
+
+  for (; i < values.size(); i++) {
+    count += values[i] == value ? 1 : 0;
+  }
+  return count;
+}
+
+/// \brief Reduces a non-empty span with a vector and a scalar version of the same operation.
+template <typename T, typename TVectorOp, typename TScalarOp>
+T simd_reduce(std::span<const T> values, TVectorOp vector_op, TScalarOp scalar_op) {
+  std::size_t i = 0;
+  T result = values[0];
+  if constexpr (has_simd_ops<T>) {
+    using ops = simd_ops<T>;
+    if (values.size() >= ops::width) {
+      auto accumulator = ops::load(values.data());
+      for (i = ops::width; i + ops::width <= values.size(); i += ops::width) {
+        accumulator = vector_op(accumulator, ops::load(values.data() + i));
+      }
+      result = reduce_lanes<T>(accumulator, scalar_op);
+    } else {
+      i = 1;
+    }
+  } else {
+    i = 1;
+  }
+
+  for (; i < values.size(); i++) {
+    result = scalar_op(result, values[i]);
+  }
+  return result;
+}
+
+template <typename T>
+T simd_min(std::span<const T> values) {
+  constexpr auto scalar_min = [](T a, T b) { return b < a ? b : a; };
+  if constexpr (has_simd_ops<T>) {
+    return simd_reduce(values, simd_ops<T>::min, scalar_min);
+  } else {
+    return simd_reduce(values, scalar_min, scalar_min);
+  }
+}
+
+template <typename T>
+T simd_max(std::span<const T> values) {
+  constexpr auto scalar_max = [](T a, T b) { return a < b ? b : a; };
+  if constexpr (has_simd_ops<T>) {
+    return simd_reduce(values, simd_ops<T>::max, scalar_max);
+  } else {
+    return simd_reduce(values, scalar_max, scalar_max);
+  }
+}
+
+template <typename T>
+T simd_sum(std::span<const T> values) {
+  if (values.empty()) {
+    return T{};
+  }
+
+  constexpr auto scalar_add = [](T a, T b) {
+    if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>) {
+      // integers wrap around like the vector path does
+      using unsigned_type = std::make_unsigned_t<T>;
+      return static_cast<T>(static_cast<unsigned_type>(a) + static_cast<unsigned_type>(b));
+    } else {
+      return static_cast<T>(a + b);
+    }
+  };
+  if constexpr (has_simd_ops<T>) {
+    return simd_reduce(values, simd_ops<T>::add, scalar_add);
+  } else {
+    return simd_reduce(values, scalar_add, scalar_add);
+  }
+}
+
+}  // namespace detail
+
+}  // namespace ccol
+
+#endif  // CONCURRENTCOLLECTIONS_SIMD_H_
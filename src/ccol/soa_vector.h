@@ -0,0 +1,282 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+
+#ifndef CONCURRENTCOLLECTIONS_SOA_VECTOR_H_
+#define CONCURRENTCOLLECTIONS_SOA_VECTOR_H_
+
+#include <ccol/common.h>
+#include <ccol/epoch.h>
+#include <ccol/memory.h>
+#include <ccol/spinlock.h>
+#include <ccol/trivial_vector.h>
+
+#include <stdexcept>
+#include <tuple>
+
+namespace ccol {
+
+/// \brief A struct-of-arrays version of sparse_vector where each field is stored in its own column.
+/// \details Elements live in pages of \p TBucketSize elements that never move once allocated. Inside a page
+/// every field has its own cache line aligned array, so a pass over one field only loads that field.
+/// Appending and indexing behave like sparse_vector: appends are serialized by a write lock, trimmed and
+/// freed pages are retired, and references and spans stay valid while the caller holds an epoch::guard taken
+/// before the page was trimmed or freed. Lookups go through the page table the reader sees, an index or page
+/// that is no longer there throws std::out_of_range.
+/// Fields must be default constructible because whole pages are constructed up front.
+template <std::size_t TBucketSize, typename... TFields>
+class soa_vector final {
+ public:
+  static_assert(sizeof...(TFields) > 0, "SoA vector needs at least one field");
+  static_assert(
+      (std::is_default_constructible_v<TFields> && ...), "SoA vector fields need to be default constructible"
+  );
+
+  using value_type = std::tuple<TFields...>;
+  using reference = std::tuple<TFields&...>;
+  using const_reference = std::tuple<const TFields&...>;
+  using size_type = std::size_t;
+  using difference_type = std::size_t;
+
+  template <std::size_t I>
+  using field_type = std::tuple_element_t<I, value_type>;
+
+  static constexpr std::size_t column_alignment = 64;
+
+  soa_vector() = default;
+  soa_vector(const soa_vector&) = delete;
+  soa_vector& operator=(const soa_vector&) = delete;
+  /// \details Nobody can be reading a vector that is being destroyed, so the pages are deleted right away.
+  ~soa_vector() {
+    for (page_type* page : pages_) {
+      delete_page(page);
+    }
+  }
+
+  /// \returns The index of the new element.
+  size_type push_back(const TFields&... fields) {
+    std::lock_guard _scoped_lock(write_lock_);
+    const size_type placement_position = reserve_slot();
+    assign(placement_position, std::index_sequence_for<TFields...>{}, fields...);
+    size_.store(placement_position + 1);
+    return placement_position;
+  }
+
+  /// \returns The index of the new element.
+  size_type emplace_back(TFields&&... fields) {
+    std::lock_guard _scoped_lock(write_lock_);
+    const size_type placement_position = reserve_slot();
+    assign(placement_position, std::index_sequence_for<TFields...>{}, std::move(fields)...);
+    size_.store(placement_position + 1);
+    return placement_position;
+  }
+
+  /// \brief The lookup pins on its own, the returned reference is only covered by a guard the caller holds.
+  /// \throws std::out_of_range if the page of \p index was freed.
+  template <std::size_t I>
+  [[nodiscard]] field_type<I>& get(size_type index) {
+    const epoch::guard _pinned;
+    return column_of<I>(page_at(index / TBucketSize))[index % TBucketSize];
+  }
+
+  template <std::size_t I>
+  [[nodiscard]] const field_type<I>& get(size_type index) const {
+    const epoch::guard _pinned;
+    return column_of<I>(page_at(index / TBucketSize))[index % TBucketSize];
+  }
+
+  reference operator[](size_type index) { return at(index, std::index_sequence_for<TFields...>{}); }
+  const_reference operator[](size_type index) const { return at(index, std::index_sequence_for<TFields...>{}); }
+
+  /// \brief The values of field \p I in page \p page_index that are below size().
+  /// \throws std::out_of_range if page \p page_index was freed.
+  template <std::size_t I>
+  [[nodiscard]] std::span<field_type<I>> column(size_type page_index) {
+    const epoch::guard _pinned;
+    const size_type in_page = page_size(page_index, size());
+    return {column_of<I>(page_at(page_index)).data(), in_page};
+  }
+
+  template <std::size_t I>
+  [[nodiscard]] std::span<const field_type<I>> column(size_type page_index) const {
+    const epoch::guard _pinned;
+    const size_type in_page = page_size(page_index, size());
+    return {column_of<I>(page_at(page_index)).data(), in_page};
+  }
+
+  /// \brief Calls \p func with one span per requested field for every page that holds elements.
+  /// \details The size is read once per call, so every span handed to \p func has the same length even while
+  /// elements are being appended. Elements appended during the call are not visited. The whole walk goes
+  /// through one pinned page table, so pages that are freed meanwhile stay alive until it returns.
+  /// \code
+  /// positions.for_each_page<0, 1>([](std::span<float> x, std::span<const float> velocity) { ... });
+  /// \endcode
+  template <std::size_t... I, typename TFunc>
+  void for_each_page(TFunc&& func) {
+    const size_type current_size = size();
+    pages_.read([&func, current_size](std::span<page_type* const> pages) {
+      const size_type pages_in_use = std::min(pages.size(), (current_size + TBucketSize - 1) / TBucketSize);
+      for (size_type page_index = 0; page_index < pages_in_use; page_index++) {
+        const size_type in_page = page_size(page_index, current_size);
+        func(std::span<field_type<I>>(column_of<I>(pages[page_index]).data(), in_page)...);
+      }
+    });
+  }
+
+  template <std::size_t... I, typename TFunc>
+  void for_each_page(TFunc&& func) const {
+    const size_type current_size = size();
+    pages_.read([&func, current_size](std::span<page_type* const> pages) {
+      const size_type pages_in_use = std::min(pages.size(), (current_size + TBucketSize - 1) / TBucketSize);
+      for (size_type page_index = 0; page_index < pages_in_use; page_index++) {
+        const size_type in_page = page_size(page_index, current_size);
+        func(std::span<const field_type<I>>(column_of<I>(pages[page_index]).data(), in_page)...);
+      }
+    });
+  }
+
+  [[nodiscard]] size_type size() const { return size_.load(); }
+  /// \brief Number of pages that hold elements.
+  [[nodiscard]] size_type page_count() const { return (size() + TBucketSize - 1) / TBucketSize; }
+  /// \brief Sets the vector size to 0 but doesn't free any memory.
+  /// \see trim()
+  void clear() { size_.store(0); }
+  /// \brief Number of elements that fit in the allocated pages.
+  [[nodiscard]] size_type capacity() const { return pages_.size() * TBucketSize; }
+  /// \brief Bytes held by the allocated pages and the page table.
+  [[nodiscard]] size_type memory_bytes() const { return pages_.size() * sizeof(page_type) + pages_.memory_bytes(); }
+
+  /// \brief Frees the pages.
+  /// \details The pages are retired, lookups that run concurrently need to hold an epoch::guard from their
+  /// size() check until they are done with the element.
+  /// \see sparse_vector::free()
+  void free() {
+    std::scoped_lock scoped_lock(page_lock_, write_lock_);
+
+    clear();
+    retire_pages_from(0);
+  }
+
+  /// \brief Resets the fields past size() to their default values and frees the trailing pages that hold
+  /// none, keeping at least \p keep_pages pages around for reuse.
+  /// \see sparse_vector::trim()
+  void trim(size_type keep_pages = 0) {
+    std::scoped_lock scoped_lock(page_lock_, write_lock_);
+
+    const size_type used_pages = page_count();
+    const size_type kept_pages = std::min(std::max(used_pages, keep_pages), pages_.size());
+    retire_pages_from(kept_pages);
+
+    for (size_type index = size(); index < kept_pages * TBucketSize; index++) {
+      assign(index, std::index_sequence_for<TFields...>{}, TFields{}...);
+    }
+  }
+
+  /// \brief Frees every page that holds no elements and the unused part of the page table.
+  /// \see sparse_vector::shrink_to_fit()
+  void shrink_to_fit() {
+    trim(0);
+    pages_.shrink_to_fit();
+  }
+
+ private:
+  template <typename TField>
+  struct alignas(column_alignment) page_column {
+    std::array<TField, TBucketSize> values;
+  };
+
+  struct page_type {
+    std::tuple<page_column<TFields>...> columns;
+  };
+
+  template <std::size_t I>
+  static std::array<field_type<I>, TBucketSize>& column_of(page_type* page) {
+    return std::get<I>(page->columns).values;
+  }
+
+  /// \brief Elements of page \p page_index that are below \p current_size.
+  [[nodiscard]] static size_type page_size(size_type page_index, size_type current_size) {
+    const size_type first = page_index * TBucketSize;
+    return std::min(TBucketSize, current_size - std::min(current_size, first));
+  }
+
+  template <std::size_t... I>
+  reference at(size_type index, std::index_sequence<I...>) {
+    return reference(get<I>(index)...);
+  }
+
+  template <std::size_t... I>
+  const_reference at(size_type index, std::index_sequence<I...>) const {
+    return const_reference(get<I>(index)...);
+  }
+
+  template <std::size_t... I, typename... TValues>
+  void assign(size_type index, std::index_sequence<I...>, TValues&&... values) {
+    page_type* page = pages_[index / TBucketSize];
+    ((column_of<I>(page)[index % TBucketSize] = std::forward<TValues>(values)), ...);
+  }
+
+  /// \brief Makes sure the next index has a page. Needs write_lock_.
+  /// \details The size is only bumped once the fields are assigned, so readers never see a half written element.
+  size_type reserve_slot() {
+    const size_type placement_position = size_.load();
+    if (placement_position / TBucketSize >= pages_.size()) {
+      create_page_for(placement_position);
+    }
+    return placement_position;
+  }
+
+  void create_page_for(size_type index) {
+    std::lock_guard _scoped_lock(page_lock_);
+    if (index / TBucketSize < pages_.size()) {
+      return;
+    }
+
+    pages_.push_back(new page_type());
+    detail::track_allocation(sizeof(page_type));
+  }
+
+  /// \brief Finds page \p page_index in the page table the calling thread sees, which needs a guard.
+  page_type* page_at(size_type page_index) const {
+    page_type* page = pages_.read([page_index](std::span<page_type* const> pages) -> page_type* {
+      return page_index < pages.size() ? pages[page_index] : nullptr;
+    });
+    if (page == nullptr) {
+      throw std::out_of_range("soa_vector page was freed");
+    }
+    return page;
+  }
+
+  static void delete_page(page_type* page) {
+    delete page;
+    detail::track_deallocation(sizeof(page_type));
+  }
+
+  /// \brief Unlinks the pages from \p first_page on and retires them. Needs page_lock_.
+  /// \see sparse_vector::retire_pages_from()
+  void retire_pages_from(size_type first_page) {
+    std::vector<page_type*> unlinked;
+    pages_.read([&unlinked, first_page](std::span<page_type* const> pages) {
+      if (first_page < pages.size()) {
+        unlinked.assign(pages.begin() + static_cast<std::ptrdiff_t>(first_page), pages.end());
+      }
+    });
+    pages_.resize(std::min(first_page, pages_.size()));
+
+    for (page_type* page : unlinked) {
+      epoch::retire(page, 1, [](void* retired_page, std::size_t) {
+        delete_page(static_cast<page_type*>(retired_page));
+      });
+    }
+  }
+
+  trivial_vector<page_type*> pages_;
+  std::atomic<std::size_t> size_ = 0;
+  mutable spin_mutex page_lock_;
+  mutable spin_mutex write_lock_;
+};
+
+}  // namespace ccol
+
+#endif  // CONCURRENTCOLLECTIONS_SOA_VECTOR_H_
@@ -7,9 +7,13 @@
 #define CONCURRENTCOLLECTIONS_SPARSE_VECTOR_H_
 
 #include <ccol/common.h>
+#include <ccol/epoch.h>
+#include <ccol/memory.h>
 #include <ccol/spinlock.h>
 #include <ccol/trivial_vector.h>
 
+#include <stdexcept>
+
 namespace ccol {
 
 /// \brief A collection that allows reference access to complex elements more safely.
@@ -134,12 +138,18 @@ class sparse_vector final {
   sparse_vector& operator=(sparse_vector&&) = default;
   sparse_vector(const sparse_vector&) = delete;
   sparse_vector& operator=(const sparse_vector&) = delete;
-  ~sparse_vector() { free(); }
+  /// \details Nobody can be reading a vector that is being destroyed, so the pages and the elements in them
+  /// are deleted right away instead of being retired.
+  ~sparse_vector() {
+    for (page_type* page : pages_) {
+      delete_page(page);
+    }
+  }
 
   void emplace_back(value_type&& new_element) {
     std::lock_guard _scoped_lock(write_lock_);
 
-    const size_type placement_position = size_++;
+    const size_type placement_position = size_.load();
     const size_type page_index = placement_position / TBucketSize;
 
     if (page_index >= pages_.size()) {
@@ -147,29 +157,68 @@ class sparse_vector final {
     }
 
     page_type* page = pages_[page_index];
-    page->emplace_back(std::move(new_element));
+    const size_type slot = placement_position % TBucketSize;
+    if (slot < page->size()) {
+      // reusing a page after clear()
+      (*page)[slot] = std::move(new_element);
+    } else {
+      page->emplace_back(std::move(new_element));
+    }
+
+    // published only once the element is written, so readers never index a slot that isn't there yet
+    size_.store(placement_position + 1);
   }
 
   /// \brief Frees the arrays.
-  /// \warning Calling this function is not thread safe.
-  /// It will delete the contents of the collection and
+  /// \details The pages are retired rather than deleted, a reference stays valid while the caller holds an
+  /// epoch::guard taken before this ran. Lookups that race with this throw std::out_of_range, see operator[].
+  /// \warning It will delete the contents of the collection and
   /// might result in invalidating iterators and references
   /// that were returned.
   void free() {
     std::scoped_lock scoped_lock(page_lock_, write_lock_);
 
     clear();
-    for (page_type* page : pages_) {
-      delete page;
+    retire_pages_from(0);
+  }
+
+  /// \brief Destroys the elements past size() and frees the trailing pages that hold none,
+  /// keeping at least \p keep_pages pages around for reuse.
+  /// \details Safe to call concurrently with writers and readers, like free(). References to elements past
+  /// size() are invalidated.
+  void trim(size_type keep_pages = 0) {
+    std::scoped_lock scoped_lock(page_lock_, write_lock_);
+
+    const size_type used_pages = (size() + TBucketSize - 1) / TBucketSize;
+    const size_type kept_pages = std::min(std::max(used_pages, keep_pages), pages_.size());
+    retire_pages_from(kept_pages);
+
+    if (used_pages > 0) {
+      page_type* last_page = pages_[used_pages - 1];
+      const size_type last_page_size = size() - (used_pages - 1) * TBucketSize;
+      while (last_page->size() > last_page_size) {
+        last_page->pop_back();
+      }
     }
 
-    pages_.clear();
+    for (size_type page_index = used_pages; page_index < kept_pages; page_index++) {
+      pages_[page_index]->clear();
+    }
+  }
+
+  /// \brief Frees every page that holds no elements and the unused part of the page table.
+  /// \details The page table is reallocated and the old one retired, lookups racing with it either find
+  /// their page in the new table or throw std::out_of_range.
+  /// \see trim()
+  void shrink_to_fit() {
+    trim(0);
+    pages_.shrink_to_fit();
   }
 
   void push_back(const value_type& new_element) {
     std::lock_guard _scoped_lock(write_lock_);
 
-    const size_type placement_position = size_++;
+    const size_type placement_position = size_.load();
     const size_type page_index = placement_position / TBucketSize;
 
     if (page_index >= pages_.size()) {
@@ -177,14 +226,38 @@ class sparse_vector final {
     }
 
     page_type* page = pages_[page_index];
-    page->push_back(new_element);
+    const size_type slot = placement_position % TBucketSize;
+    if (slot < page->size()) {
+      // reusing a page after clear()
+      (*page)[slot] = new_element;
+    } else {
+      page->push_back(new_element);
+    }
+
+    size_.store(placement_position + 1);
   }
 
   [[nodiscard]] size_type size() const { return size_.load(); }
   /// \brief Sets the vector size to 0 but doesn't free any memory.
+  /// \see trim()
   void clear() { size_.store(0); }
-  const value_type& operator[](size_type index) const { return pages_[index / TBucketSize]->at(index % TBucketSize); }
-  value_type operator[](size_type index) { return pages_[index / TBucketSize]->at(index % TBucketSize); }
+  /// \brief Number of elements that fit in the allocated pages.
+  [[nodiscard]] size_type capacity() const { return pages_.size() * TBucketSize; }
+  /// \brief Bytes held by the allocated pages and the page table.
+  [[nodiscard]] size_type memory_bytes() const { return pages_.size() * page_bytes + pages_.memory_bytes(); }
+  /// \brief Pages are reserved up front and never reallocate, so indexing doesn't touch the end the writer is
+  /// moving. The lookup pins on its own, the returned reference is only covered by a guard the caller holds.
+  /// \throws std::out_of_range if \p index is past size(), which an index taken before free(), trim() or
+  /// shrink_to_fit() can be.
+  const value_type& operator[](size_type index) const {
+    const epoch::guard _pinned;
+    return element_at(index);
+  }
+
+  value_type operator[](size_type index) {
+    const epoch::guard _pinned;
+    return element_at(index);
+  }
 
   const_iterator begin() const { return const_iterator(*this, 0); }
   const_iterator end() const { return const_iterator(*this, size()); }
@@ -198,6 +271,8 @@ class sparse_vector final {
  private:
   using page_type = std::vector<T>;
 
+  static constexpr size_type page_bytes = sizeof(page_type) + TBucketSize * sizeof(T);
+
   void create_page_for(size_type index) {
     std::lock_guard _scoped_lock(page_lock_);
     if (index / TBucketSize < pages_.size()) {
@@ -206,9 +281,52 @@ class sparse_vector final {
 
     auto* page = new page_type();
     page->reserve(TBucketSize);
+    detail::track_allocation(page_bytes);
     pages_.push_back(page);
   }
 
+  /// \brief Finds \p index through the page table the calling thread sees, which needs a guard.
+  /// \details The index is checked against size(), which is only published once the element is constructed,
+  /// and the page against that table, so a stale index never reaches a retired table or a fresh page.
+  /// The page itself isn't asked for its size, a writer may be appending to it.
+  value_type& element_at(size_type index) const {
+    if (index >= size()) {
+      throw std::out_of_range("sparse_vector index is past its size");
+    }
+
+    page_type* page = pages_.read([index](std::span<page_type* const> pages) -> page_type* {
+      const size_type page_index = index / TBucketSize;
+      return page_index < pages.size() ? pages[page_index] : nullptr;
+    });
+    if (page == nullptr) {
+      throw std::out_of_range("sparse_vector index is past its pages");
+    }
+    return (*page)[index % TBucketSize];
+  }
+
+  static void delete_page(page_type* page) {
+    delete page;
+    detail::track_deallocation(page_bytes);
+  }
+
+  /// \brief Unlinks the pages from \p first_page on and retires them. Needs page_lock_.
+  /// \details Readers that found a page before it was unlinked can keep using it until they unpin.
+  void retire_pages_from(size_type first_page) {
+    std::vector<page_type*> unlinked;
+    pages_.read([&unlinked, first_page](std::span<page_type* const> pages) {
+      if (first_page < pages.size()) {
+        unlinked.assign(pages.begin() + static_cast<std::ptrdiff_t>(first_page), pages.end());
+      }
+    });
+    pages_.resize(std::min(first_page, pages_.size()));
+
+    for (page_type* page : unlinked) {
+      epoch::retire(page, 1, [](void* retired_page, std::size_t) {
+        delete_page(static_cast<page_type*>(retired_page));
+      });
+    }
+  }
+
   trivial_vector<page_type*> pages_;
   std::atomic<std::size_t> size_ = 0;
   mutable spin_mutex page_lock_;
@@ -8,8 +8,31 @@
 
 #include <ccol/common.h>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CCOL_CPU_RELAX_PAUSE 1
+#endif
+
 namespace ccol {
 
+/// \brief Tells the CPU we are in a busy-wait loop.
+inline void cpu_relax() {
+#if defined(CCOL_CPU_RELAX_PAUSE)
+  _mm_pause();
+#elif defined(_MSC_VER) && (defined(_M_ARM64) || defined(_M_ARM))
+  __yield();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield");
+#else
+  (void)0;
+#endif
+}
+
 class spin_mutex {
  public:
   void lock() {
@@ -25,25 +48,32 @@ class spin_mutex {
   void unlock() { lock_.store(false, std::memory_order_release); }
 
  protected:
-  static void noop() {
-#if defined(__GNUC__) || defined(_MSC_VER)
-    _mm_pause();
-#else
-    (void)0;
-#endif
-  }
+  static void noop() { cpu_relax(); }
  private:
   std::atomic<bool> lock_ = {false};
 };
 
 class shared_spin_mutex : protected spin_mutex {
  public:
-  using spin_mutex::try_lock;
   using spin_mutex::is_locked;
 
+  /// \brief Takes the exclusive lock only if there are no readers either.
+  bool try_lock() {
+    if (!spin_mutex::try_lock()) {
+      return false;
+    }
+
+    if (read_count_.load(std::memory_order_acquire) > 0) {
+      spin_mutex::unlock();
+      return false;
+    }
+    return true;
+  }
+
   void lock() {
     spin_mutex::lock();
-    while (read_count_.load(std::memory_order_relaxed) > 0) {
+    // acquire pairs with unlock_shared(), so whatever the last reader did happens before we own the lock
+    while (read_count_.load(std::memory_order_acquire) > 0) {
       noop();
     }
   }
@@ -54,6 +84,10 @@ class shared_spin_mutex : protected spin_mutex {
     spin_mutex::unlock();
   }
 
+  /// \brief Registers a reader while the exclusive lock is held, so unlock() downgrades to shared access
+  /// instead of releasing and no other writer can get in between.
+  void lock_shared_while_exclusive() { read_count_++; }
+
   void unlock() { spin_mutex::unlock(); }
   void unlock_shared() { read_count_--; }
 
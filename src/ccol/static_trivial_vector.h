@@ -0,0 +1,211 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+
+#ifndef CONCURRENTCOLLECTIONS_STATIC_TRIVIAL_VECTOR_H_
+#define CONCURRENTCOLLECTIONS_STATIC_TRIVIAL_VECTOR_H_
+
+#include <ccol/common.h>
+#include <ccol/spinlock.h>
+
+#include <initializer_list>
+#include <stdexcept>
+#include <thread>
+
+namespace ccol {
+
+/// \brief A fixed capacity version of trivial_vector that stores its elements inline.
+/// \details The storage never moves, so reads don't need a lock and appends only claim slots with an atomic
+/// compare-and-swap. Appends become visible in the order their slots were claimed. It has the same interface
+/// as trivial_vector so the two can be switched at compile time.
+/// Pushing past the capacity fails: try_push_back() and try_append() return false, push_back(), append(),
+/// resize() and the initializer list constructor throw std::length_error, so no value is ever dropped silently.
+template <typename T, std::size_t N>
+class static_trivial_vector final {
+ public:
+  static_assert(std::is_trivially_copyable_v<T>, "Static trivial vector can only contain trivial elements");
+
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using iterator = const value_type*;
+  using const_iterator = iterator;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  constexpr static_trivial_vector() = default;
+
+  /// \brief Constructs the vector with \p values.
+  /// \throws std::length_error if there are more values than the capacity, which is a compile error when the
+  /// vector is constant initialized.
+  constexpr static_trivial_vector(std::initializer_list<value_type> values)
+      : size_(values.size()), claimed_(values.size()) {
+    if (values.size() > N) {
+      throw std::length_error("static_trivial_vector can't hold more values than its capacity");
+    }
+    std::copy(values.begin(), values.end(), buffer_.begin());
+  }
+
+  static_trivial_vector(const static_trivial_vector&) = delete;
+  static_trivial_vector& operator=(const static_trivial_vector&) = delete;
+
+  /// \throws std::length_error if \p new_size is past the capacity.
+  void resize(size_type new_size) {
+    if (new_size > N) {
+      throw std::length_error("static_trivial_vector can't grow past its capacity");
+    }
+
+    std::lock_guard _scoped_lock(write_mutex_);
+    const size_type old_size = claim_all(new_size);
+    if (new_size > old_size) {
+      std::fill(buffer_.begin() + old_size, buffer_.begin() + new_size, T{});
+    }
+    size_.store(new_size, std::memory_order_release);
+  }
+
+  value_type operator[](size_type index) const { return buffer_[index]; }
+
+  /// \brief Pushes like trivial_vector::push_back(), which never drops values.
+  /// \throws std::length_error if the vector is full.
+  void push_back(value_type new_value) {
+    if (!try_push_back(new_value)) {
+      throw std::length_error("static_trivial_vector is full");
+    }
+  }
+
+  /// \returns False if the vector is full.
+  bool try_push_back(value_type new_value) {
+    size_type slot = claimed_.load(std::memory_order_relaxed);
+    do {
+      if (slot >= N) {
+        return false;
+      }
+    } while (!claimed_.compare_exchange_weak(slot, slot + 1, std::memory_order_relaxed));
+
+    buffer_[slot] = new_value;
+    publish(slot, slot + 1);
+    return true;
+  }
+
+  /// \brief Appends a range of values into consecutive slots.
+  /// \throws std::length_error without appending anything if the values don't fit.
+  void append(std::span<const value_type> new_values) {
+    if (!try_append(new_values)) {
+      throw std::length_error("static_trivial_vector is full");
+    }
+  }
+
+  /// \returns False without appending anything if the values don't fit.
+  bool try_append(std::span<const value_type> new_values) {
+    if (new_values.empty()) {
+      return true;
+    }
+
+    size_type first = claimed_.load(std::memory_order_relaxed);
+    do {
+      if (new_values.size() > N - std::min(first, N)) {
+        return false;
+      }
+    } while (!claimed_.compare_exchange_weak(first, first + new_values.size(), std::memory_order_relaxed));
+
+    std::copy(new_values.begin(), new_values.end(), buffer_.begin() + first);
+    publish(first, first + new_values.size());
+    return true;
+  }
+
+  /// \brief Copies up to \p count elements starting at \p first into \p destination.
+  /// \returns The number of elements that were copied.
+  size_type copy_to(value_type* destination, size_type count, size_type first = 0) const {
+    const size_type current_size = size();
+    if (first >= current_size) {
+      return 0;
+    }
+
+    count = std::min(count, current_size - first);
+    std::copy(buffer_.begin() + first, buffer_.begin() + first + count, destination);
+    return count;
+  }
+
+  /// \brief Calls \p func with a span over the published elements.
+  template <typename TFunc>
+    requires std::invocable<TFunc&, std::span<const value_type>>
+  decltype(auto) read(TFunc&& func) const {
+    return func(std::span<const value_type>(buffer_.data(), size()));
+  }
+
+  /// \brief Calls \p func with a mutable span over the published elements while holding the write lock once.
+  /// \details Like replace(), concurrent readers can observe the elements while they are being modified.
+  template <typename TFunc>
+    requires std::invocable<TFunc&, std::span<value_type>>
+  decltype(auto) write(TFunc&& func) {
+    std::lock_guard _scoped_lock(write_mutex_);
+    return func(std::span<value_type>(buffer_.data(), size()));
+  }
+
+  void replace(size_type index, value_type new_value) {
+    std::lock_guard _scoped_lock(write_mutex_);
+    buffer_[index] = new_value;
+  }
+
+  [[nodiscard]] value_type exchange(size_type index, value_type new_value) {
+    std::lock_guard _scoped_lock(write_mutex_);
+    value_type old = buffer_[index];
+    buffer_[index] = new_value;
+    return old;
+  }
+
+  iterator begin() const { return buffer_.data(); }
+  iterator end() const { return buffer_.data() + size(); }
+  size_type size() const { return size_.load(std::memory_order_acquire); }
+  bool empty() const { return size() == 0; }
+  void clear() { resize(0); }
+  static constexpr size_type capacity() { return N; }
+  /// \brief Bytes of inline element storage, none of it is heap allocated.
+  static constexpr size_type memory_bytes() { return N * sizeof(value_type); }
+  /// \brief Does nothing, the storage is inline. Kept for interface parity with trivial_vector.
+  void shrink_to_fit() {}
+
+ private:
+  /// \brief Spins for a while, then yields so a preempted appender can finish publishing.
+  static void backoff(std::uint32_t spins) {
+    if (spins < 64) {
+      cpu_relax();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  /// \brief Makes the slots [first, last) visible once every earlier claimed slot is visible.
+  void publish(size_type first, size_type last) {
+    size_type expected = first;
+    for (std::uint32_t spins = 0;
+         !size_.compare_exchange_weak(expected, last, std::memory_order_release, std::memory_order_relaxed);
+         spins++) {
+      expected = first;
+      backoff(spins);
+    }
+  }
+
+  /// \brief Waits for in-flight appends and claims every slot up to \p new_size.
+  /// \returns The size before the claim.
+  size_type claim_all(size_type new_size) {
+    size_type current = claimed_.load(std::memory_order_acquire);
+    do {
+      for (std::uint32_t spins = 0; size_.load(std::memory_order_acquire) != current; spins++) {
+        backoff(spins);
+        current = claimed_.load(std::memory_order_acquire);
+      }
+    } while (!claimed_.compare_exchange_weak(current, new_size, std::memory_order_acq_rel, std::memory_order_acquire));
+    return current;
+  }
+
+  std::array<value_type, N> buffer_{};
+  std::atomic<size_type> size_ = 0;
+  std::atomic<size_type> claimed_ = 0;
+  mutable spin_mutex write_mutex_;
+};
+
+}  // namespace ccol
+
+#endif  // CONCURRENTCOLLECTIONS_STATIC_TRIVIAL_VECTOR_H_
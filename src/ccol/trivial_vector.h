@@ -7,14 +7,19 @@
 #define CONCURRENTCOLLECTIONS_CONCURRENT_POINTER_VECTOR_H_
 
 #include <ccol/common.h>
+#include <ccol/epoch.h>
+#include <ccol/memory.h>
 #include <ccol/spinlock.h>
 
+#include <stdexcept>
+
 namespace ccol {
 
 /// \brief A resizable collection for trivial types.
 /// \details Since trivial types are easy to copy we can make an easy to use collection that can
 /// be read to while being resized or written to safely. Any modification still includes
 /// a locking mechanism which is why read access copies the elements.
+/// Readers only pin the epoch, a reallocation retires the old buffer and never waits for them.
 template <typename T>
 class trivial_vector final {
  public:
@@ -81,31 +86,93 @@ class trivial_vector final {
   using reverse_iterator = std::reverse_iterator<iterator>;
   using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
+  trivial_vector() = default;
+  trivial_vector(const trivial_vector&) = delete;
+  trivial_vector& operator=(const trivial_vector&) = delete;
+
+  ~trivial_vector() { detail::deallocate_array(buffer_.exchange(nullptr), reserved_.load()); }
+
   void resize(size_type new_size) {
     std::lock_guard _scoped_lock(write_mutex_);
     resize_no_lock(new_size);
   }
 
+  /// \brief Reads through the buffer the reader pinned, bounded by that buffer's capacity.
+  /// \details The bound is the capacity rather than size(), so a lookup doesn't touch the size appenders keep
+  /// writing. Like before shrinking existed, an index between size() and capacity() reads a stale element.
+  /// \throws std::out_of_range if \p index is past the capacity, which an index taken before a shrink can be.
   value_type operator[](size_type index) const {
-    std::shared_lock _scoped_lock(reader_mutex_);
-    return safe_buffers_[active_buffer_.load()][index];
+    const epoch::guard _pinned;
+    const std::span<const value_type> buffer = pinned_buffer();
+    if (index >= buffer.size()) {
+      throw std::out_of_range("trivial_vector index is past its buffer");
+    }
+    return buffer[index];
   }
 
   void push_back(value_type new_value) {
     std::lock_guard _scoped_lock(write_mutex_);
-    resize_no_lock(size() + 1);
-    safe_buffers_[active_buffer_.load()][size() - 1] = new_value;
+    const size_type placement_position = size();
+    reserve_no_lock(placement_position + 1);
+    buffer_.load()[placement_position] = new_value;
+    size_.store(placement_position + 1);
+  }
+
+  /// \brief Appends a range of values with a single lock acquisition and a single copy.
+  void append(std::span<const value_type> new_values) {
+    if (new_values.empty()) {
+      return;
+    }
+
+    std::lock_guard _scoped_lock(write_mutex_);
+    const size_type first = size();
+    reserve_no_lock(first + new_values.size());
+    std::copy(new_values.begin(), new_values.end(), buffer_.load() + first);
+    size_.store(first + new_values.size());
+  }
+
+  /// \brief Copies up to \p count elements starting at \p first into \p destination while pinned once.
+  /// \returns The number of elements that were copied.
+  size_type copy_to(value_type* destination, size_type count, size_type first = 0) const {
+    const epoch::guard _pinned;
+    const std::span<const value_type> values = pinned_values();
+    if (first >= values.size()) {
+      return 0;
+    }
+
+    count = std::min(count, values.size() - first);
+    std::copy(values.begin() + first, values.begin() + first + count, destination);
+    return count;
+  }
+
+  /// \brief Calls \p func with a span over the elements while pinned once.
+  /// \details The span is only valid inside \p func. Resizing doesn't wait for \p func, the span keeps
+  /// pointing at the buffer it was taken from, which stays alive until \p func returns.
+  template <typename TFunc>
+    requires std::invocable<TFunc&, std::span<const value_type>>
+  decltype(auto) read(TFunc&& func) const {
+    const epoch::guard _pinned;
+    return func(pinned_values());
+  }
+
+  /// \brief Calls \p func with a mutable span over the elements while holding the write lock once.
+  /// \details Like replace(), concurrent readers can observe the elements while they are being modified.
+  template <typename TFunc>
+    requires std::invocable<TFunc&, std::span<value_type>>
+  decltype(auto) write(TFunc&& func) {
+    std::lock_guard _scoped_lock(write_mutex_);
+    return func(std::span<value_type>(buffer_.load(), size()));
   }
 
   void replace(size_type index, value_type new_value) {
     std::lock_guard _scoped_lock(write_mutex_);
-    safe_buffers_[active_buffer_.load()][index] = new_value;
+    buffer_.load()[index] = new_value;
   }
 
   [[nodiscard]] value_type exchange(size_type index, value_type new_value) {
     std::lock_guard _scoped_lock(write_mutex_);
-    value_type old = safe_buffers_[active_buffer_.load()][index];
-    safe_buffers_[active_buffer_.load()][index] = new_value;
+    value_type old = buffer_.load()[index];
+    buffer_.load()[index] = new_value;
     return old;
   }
 
@@ -114,12 +181,25 @@ class trivial_vector final {
   size_type size() const { return size_.load(); }
   bool empty() const { return size() == 0; }
   void clear() { resize(0); }
+  /// \brief Number of elements that fit before the next reallocation.
+  size_type capacity() const { return reserved_.load(); }
+  /// \brief Bytes of element storage currently held.
+  size_type memory_bytes() const { return capacity() * sizeof(value_type); }
+
+  /// \brief Reallocates the storage to fit the current size exactly, or frees it if the vector is empty.
+  /// \details Safe to call concurrently with readers and writers, the old buffer is retired and freed once
+  /// the readers that might still use it have unpinned. A reader holding an index past the new capacity gets
+  /// std::out_of_range from operator[] rather than reading the buffer that was freed.
+  void shrink_to_fit() {
+    std::lock_guard _scoped_lock(write_mutex_);
+    if (reserved_.load() > size()) {
+      reallocate_no_lock(size(), size());
+    }
+  }
 
  private:
-  std::array<std::atomic<value_type*>, 2> safe_buffers_{nullptr, nullptr};
-  mutable shared_spin_mutex reader_mutex_;
+  std::atomic<value_type*> buffer_ = nullptr;
   mutable spin_mutex write_mutex_;
-  std::atomic<std::uint8_t> active_buffer_ = 0;
   std::atomic<size_type> size_ = 0;
   std::atomic<size_type> reserved_ = 0;
 
@@ -130,30 +210,80 @@ class trivial_vector final {
     }
 
     if (reserved_.load() < new_size) {
-      size_type new_reserved = reserved_.load() == 0 ? 2 : reserved_.load() * 2;
-      auto* new_buffer = new value_type[new_reserved];
-      if (size() > 0) {
-        auto* current_active_buffer = safe_buffers_[active_buffer_.load()].load();
-        std::copy(current_active_buffer, current_active_buffer + size(), new_buffer);
+      reallocate_no_lock(grown_reservation(new_size), new_size);
+    } else {
+      size_.store(new_size);
+    }
+  }
+
+  /// \brief Makes room for \p new_size elements without publishing them, so appends can write the new
+  /// elements before bumping the size and readers never see a slot that isn't written yet.
+  void reserve_no_lock(size_type new_size) {
+    if (reserved_.load() < new_size) {
+      reallocate_no_lock(grown_reservation(new_size), size());
+    }
+  }
+
+  [[nodiscard]] size_type grown_reservation(size_type new_size) const {
+    size_type new_reserved = reserved_.load() == 0 ? 2 : reserved_.load() * 2;
+    while (new_reserved < new_size) {
+      new_reserved *= 2;
+    }
+    return new_reserved;
+  }
+
+  /// \brief The whole buffer as seen by a pinned reader, up to its capacity.
+  /// \details The buffer and its capacity are two atomics, so they are read until the buffer is stable: a pinned
+  /// buffer can't be freed and come back at the same address, and reallocate_no_lock() publishes
+  /// the smaller of the two capacities first, so the capacity read in between never overstates the buffer.
+  [[nodiscard]] std::span<const value_type> pinned_buffer() const {
+    value_type* buffer = buffer_.load();
+    while (true) {
+      const size_type capacity = reserved_.load();
+      value_type* stable_buffer = buffer_.load();
+      if (stable_buffer == buffer) {
+        return {buffer, capacity};
       }
-      std::fill(new_buffer + size(), new_buffer + new_size, T{});
+      buffer = stable_buffer;
+    }
+  }
 
-      // sanity check make sure back buffer is free
-      auto* old_buffer = safe_buffers_[active_buffer_.load() ^ 1].exchange(new_buffer);
-      delete[] old_buffer;
+  /// \brief The elements as seen by a pinned reader, never longer than the buffer they point into.
+  /// \details The size is read first, it only outgrows a buffer after a bigger one was published.
+  [[nodiscard]] std::span<const value_type> pinned_values() const {
+    const size_type current_size = size();
+    const std::span<const value_type> buffer = pinned_buffer();
+    return buffer.first(std::min(current_size, buffer.size()));
+  }
 
-      reader_mutex_.lock();
-      std::uint8_t back_index_after_swap = active_buffer_.fetch_xor(1);
-      size_.store(new_size);
-      reserved_.store(new_reserved);
-      reader_mutex_.unlock();
+  /// \brief Moves the elements to a buffer of \p new_reserved elements (none if 0) and sets the size.
+  /// \details Elements between the current size and \p new_size are value initialized.
+  /// The old buffer is retired, readers that still hold it keep reading the old contents until they unpin.
+  void reallocate_no_lock(size_type new_reserved, size_type new_size) {
+    const size_type kept = std::min(size(), new_size);
+    value_type* old_buffer = buffer_.load();
+    const size_type old_reserved = reserved_.load();
+    value_type* new_buffer = nullptr;
+    if (new_reserved > 0) {
+      new_buffer = detail::allocate_array<value_type>(new_reserved);
+      if (kept > 0) {
+        std::copy(old_buffer, old_buffer + kept, new_buffer);
+      }
+      std::fill(new_buffer + kept, new_buffer + new_size, T{});
+    }
 
-      // free back buffer after there are no readers
-      old_buffer = safe_buffers_[back_index_after_swap].exchange(nullptr);
-      delete[] old_buffer;
+    if (new_reserved < old_reserved) {
+      reserved_.store(new_reserved);
+      buffer_.store(new_buffer);
     } else {
-      size_.store(new_size);
+      buffer_.store(new_buffer);
+      reserved_.store(new_reserved);
     }
+    size_.store(new_size);
+
+    epoch::retire(old_buffer, old_reserved, [](void* buffer, std::size_t count) {
+      detail::deallocate_array(static_cast<value_type*>(buffer), count);
+    });
   }
 };
 
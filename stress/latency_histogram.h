@@ -0,0 +1,93 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+
+#ifndef CONCURRENTCOLLECTIONS_STRESS_LATENCY_HISTOGRAM_H_
+#define CONCURRENTCOLLECTIONS_STRESS_LATENCY_HISTOGRAM_H_
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+namespace ccol::stress {
+
+/// \brief A log-linear latency histogram in the style of HdrHistogram.
+/// \details Values are bucketed by their top \p TPrecisionBits bits, which keeps the relative error
+/// below 2^-(TPrecisionBits - 1) across the whole 64 bit range with a fixed, small footprint.
+/// Every thread records into its own histogram and they are merged after the run.
+template <std::uint32_t TPrecisionBits = 6>
+class latency_histogram final {
+ public:
+  void record(std::uint64_t value) {
+    buckets_[index_of(value)]++;
+    count_++;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+
+  void merge(const latency_histogram& other) {
+    for (std::size_t i = 0; i < buckets_.size(); i++) {
+      buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+
+  [[nodiscard]] std::uint64_t count() const { return count_; }
+  [[nodiscard]] std::uint64_t min() const { return count_ == 0 ? 0 : min_; }
+  [[nodiscard]] std::uint64_t max() const { return max_; }
+  [[nodiscard]] double mean() const { return count_ == 0 ? 0.0 : static_cast<double>(sum_) / count_; }
+
+  /// \returns The highest value of the bucket that holds the \p percentile (0-100) sample.
+  [[nodiscard]] std::uint64_t percentile(double percentile) const {
+    if (count_ == 0) {
+      return 0;
+    }
+
+    const auto rank = static_cast<std::uint64_t>(percentile / 100.0 * static_cast<double>(count_ - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets_.size(); i++) {
+      seen += buckets_[i];
+      if (seen >= rank) {
+        return std::min(highest_value_of(i), max_);
+      }
+    }
+    return max_;
+  }
+
+ private:
+  static constexpr std::uint32_t half_bucket_count = 1u << (TPrecisionBits - 1);
+  static constexpr std::size_t bucket_count = (64 - TPrecisionBits) * half_bucket_count + (1u << TPrecisionBits);
+
+  static std::size_t index_of(std::uint64_t value) {
+    const std::uint32_t width = static_cast<std::uint32_t>(std::bit_width(value));
+    const std::uint32_t shift = width > TPrecisionBits ? width - TPrecisionBits : 0;
+    return static_cast<std::size_t>(shift) * half_bucket_count + static_cast<std::size_t>(value >> shift);
+  }
+
+  static std::uint64_t highest_value_of(std::size_t index) {
+    if (index < (1u << TPrecisionBits)) {
+      return index;
+    }
+
+    const std::size_t shift = (index - half_bucket_count) / half_bucket_count;
+    const std::uint64_t top = index - shift * half_bucket_count;
+    return ((top + 1) << shift) - 1;
+  }
+
+  std::array<std::uint64_t, bucket_count> buckets_{};
+  std::uint64_t count_ = 0;
+  std::uint64_t sum_ = 0;
+  std::uint64_t min_ = std::numeric_limits<std::uint64_t>::max();
+  std::uint64_t max_ = 0;
+};
+
+}  // namespace ccol::stress
+
+#endif  // CONCURRENTCOLLECTIONS_STRESS_LATENCY_HISTOGRAM_H_
@@ -0,0 +1,575 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+// Runs the containers through configurable producer / consumer / reader mixes for a fixed time, records
+// per-operation latency and checks that every pushed element comes out exactly once.
+//
+#include <ccol/arena_queue.h>
+#include <ccol/double_buffer_queue.h>
+#include <ccol/sparse_vector.h>
+#include <ccol/static_trivial_vector.h>
+#include <ccol/trivial_vector.h>
+
+#include <barrier>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#include "latency_histogram.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__SANITIZE_THREAD__)
+#define CCOL_STRESS_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define CCOL_STRESS_TSAN 1
+#endif
+#endif
+
+namespace ccol::stress {
+
+using histogram = latency_histogram<>;
+using clock = std::chrono::steady_clock;
+
+struct options {
+  std::string container = "all";
+  std::uint32_t producers = 2;
+  std::uint32_t consumers = 1;
+  std::uint32_t readers = 2;
+  std::chrono::milliseconds duration{1000};
+  bool pin = false;
+  /// \brief If set, producers and readers step together through 1, 2, 4 ... up to this count.
+  std::uint32_t sweep = 0;
+};
+
+/// \brief What one container run reports back to main.
+struct outcome {
+  bool ok = false;
+  /// \brief Operations per second, per operation name.
+  std::vector<std::pair<std::string, double>> throughput;
+};
+
+/// \brief Elements carry who pushed them and in which order so the checker can find lost and duplicated ones.
+/// \details Producers are stored off by one, so a zeroed slot that a reader sees before it was written decodes
+/// to an invalid producer and counts as corrupted.
+constexpr std::uint64_t encode(std::uint32_t producer, std::uint64_t sequence) {
+  return (static_cast<std::uint64_t>(producer + 1) << 40) | sequence;
+}
+
+constexpr std::uint32_t producer_of(std::uint64_t value) { return static_cast<std::uint32_t>(value >> 40) - 1; }
+constexpr std::uint64_t sequence_of(std::uint64_t value) { return value & ((std::uint64_t{1} << 40) - 1); }
+
+void pin_to_core(std::uint32_t thread_index) {
+  const std::uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+  const std::uint32_t core = thread_index % cores;
+#if defined(_WIN32)
+  SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{1} << core);
+#elif defined(__linux__)
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(core, &cpu_set);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#else
+  (void)core;
+#endif
+}
+
+/// \brief Times \p operation into \p latencies.
+template <typename TOperation>
+decltype(auto) timed(histogram& latencies, TOperation&& operation) {
+  const auto start = clock::now();
+  if constexpr (std::is_void_v<decltype(operation())>) {
+    operation();
+    latencies.record(static_cast<std::uint64_t>((clock::now() - start).count()));
+  } else {
+    decltype(auto) result = operation();
+    latencies.record(static_cast<std::uint64_t>((clock::now() - start).count()));
+    return result;
+  }
+}
+
+/// \brief Collects what came out of a container and compares it with what went in.
+class tally final {
+ public:
+  explicit tally(std::uint32_t producers)
+      : seen_(producers), pushed_(producers, 0) {}
+
+  void pushed(std::uint32_t producer, std::uint64_t count) { pushed_[producer] = count; }
+
+  /// \brief Not thread safe, consumers keep their own tally and merge it.
+  void seen(std::uint64_t value) {
+    const std::uint32_t producer = producer_of(value);
+    if (producer >= seen_.size()) {
+      corrupted_++;
+      return;
+    }
+    seen_[producer].push_back(sequence_of(value));
+  }
+
+  void merge(tally& other) {
+    for (std::size_t producer = 0; producer < seen_.size(); producer++) {
+      seen_[producer].insert(seen_[producer].end(), other.seen_[producer].begin(), other.seen_[producer].end());
+      other.seen_[producer].clear();
+    }
+    corrupted_ += other.corrupted_;
+  }
+
+  struct result {
+    std::uint64_t pushed = 0;
+    std::uint64_t lost = 0;
+    std::uint64_t duplicated = 0;
+    std::uint64_t corrupted = 0;
+
+    [[nodiscard]] bool ok() const { return lost == 0 && duplicated == 0 && corrupted == 0; }
+  };
+
+  result check() {
+    result checked{.corrupted = corrupted_};
+    for (std::size_t producer = 0; producer < seen_.size(); producer++) {
+      auto& sequences = seen_[producer];
+      std::sort(sequences.begin(), sequences.end());
+      std::uint64_t unique = 0;
+      for (std::size_t i = 0; i < sequences.size(); i++) {
+        if (sequences[i] >= pushed_[producer]) {
+          checked.corrupted++;
+        } else if (i > 0 && sequences[i] == sequences[i - 1]) {
+          checked.duplicated++;
+        } else {
+          unique++;
+        }
+      }
+      checked.pushed += pushed_[producer];
+      checked.lost += pushed_[producer] - unique;
+    }
+    return checked;
+  }
+
+ private:
+  std::vector<std::vector<std::uint64_t>> seen_;
+  std::vector<std::uint64_t> pushed_;
+  std::uint64_t corrupted_ = 0;
+};
+
+/// \brief Latencies of one kind of operation, one histogram per thread merged at the end.
+struct operation_stats {
+  std::string name;
+  std::vector<histogram> per_thread;
+
+  [[nodiscard]] histogram merged() const {
+    histogram all;
+    for (const histogram& latencies : per_thread) {
+      all.merge(latencies);
+    }
+    return all;
+  }
+};
+
+/// \brief Starts roles together, stops them after the configured duration and joins them.
+class run final {
+ public:
+  explicit run(const options& config)
+      : config_(config) {}
+
+  /// \brief Adds \p count threads running \p role(thread_in_role, latencies) until stop is requested.
+  void add(std::string name, std::uint32_t count, std::function<void(std::uint32_t, histogram&)> role) {
+    stats_.push_back({std::move(name), std::vector<histogram>(count)});
+    roles_.push_back({count, std::move(role)});
+  }
+
+  [[nodiscard]] bool stopping() const { return stop_.load(std::memory_order_relaxed); }
+
+  /// \brief Runs every role, \p after_stop runs once the time is up, before the threads are joined.
+  void start() {
+    std::uint32_t total = 0;
+    for (const auto& role : roles_) {
+      total += role.count;
+    }
+
+    std::barrier sync_point(static_cast<std::ptrdiff_t>(total + 1));
+    std::vector<std::jthread> threads;
+    std::uint32_t thread_index = 0;
+    for (std::size_t role_index = 0; role_index < roles_.size(); role_index++) {
+      for (std::uint32_t i = 0; i < roles_[role_index].count; i++) {
+        threads.emplace_back([this, &sync_point, role_index, i, thread_index] {
+          if (config_.pin) {
+            pin_to_core(thread_index);
+          }
+          sync_point.arrive_and_wait();
+          roles_[role_index].body(i, stats_[role_index].per_thread[i]);
+        });
+        thread_index++;
+      }
+    }
+
+    sync_point.arrive_and_wait();
+    const auto started = clock::now();
+    std::this_thread::sleep_for(config_.duration);
+    stop_.store(true);
+    threads.clear();
+    elapsed_ = clock::now() - started;
+  }
+
+  /// \brief Prints the latencies and the check result.
+  /// \returns The outcome with the throughput of every operation.
+  outcome report(const std::string& container, const tally::result& checked) const {
+    outcome reported{.ok = checked.ok(), .throughput = {}};
+    const double seconds = std::chrono::duration<double>(elapsed_).count();
+    std::printf("== %s (%.2fs)\n", container.c_str(), seconds);
+    std::printf(
+        "  %-10s %8s %12s %9s %9s %9s %9s %9s %11s\n",
+        "operation",
+        "threads",
+        "ops/s",
+        "mean ns",
+        "p50 ns",
+        "p99 ns",
+        "p99.9 ns",
+        "p99.99 ns",
+        "max ns"
+    );
+    for (const auto& stats : stats_) {
+      if (stats.per_thread.empty()) {
+        continue;
+      }
+      const histogram all = stats.merged();
+      reported.throughput.emplace_back(stats.name, static_cast<double>(all.count()) / seconds);
+      std::printf(
+          "  %-10s %8zu %12.0f %9.0f %9llu %9llu %9llu %9llu %11llu\n",
+          stats.name.c_str(),
+          stats.per_thread.size(),
+          static_cast<double>(all.count()) / seconds,
+          all.mean(),
+          static_cast<unsigned long long>(all.percentile(50.0)),
+          static_cast<unsigned long long>(all.percentile(99.0)),
+          static_cast<unsigned long long>(all.percentile(99.9)),
+          static_cast<unsigned long long>(all.percentile(99.99)),
+          static_cast<unsigned long long>(all.max())
+      );
+    }
+    std::printf(
+        "  elements: %llu pushed, %llu lost, %llu duplicated, %llu corrupted -> %s\n",
+        static_cast<unsigned long long>(checked.pushed),
+        static_cast<unsigned long long>(checked.lost),
+        static_cast<unsigned long long>(checked.duplicated),
+        static_cast<unsigned long long>(checked.corrupted),
+        checked.ok() ? "OK" : "FAILED"
+    );
+    return reported;
+  }
+
+ private:
+  struct role {
+    std::uint32_t count;
+    std::function<void(std::uint32_t, histogram&)> body;
+  };
+
+  const options& config_;
+  std::vector<role> roles_;
+  std::vector<operation_stats> stats_;
+  std::atomic<bool> stop_ = false;
+  clock::duration elapsed_{};
+};
+
+/// \brief Producers push into a double_buffer_queue, consumers swap and drain every batch inside the swap
+/// so no batch can be missed, readers hold the front buffer and scan it.
+outcome stress_double_buffer_queue(const options& config) {
+  ccol::double_buffer_queue<std::uint64_t> queue;
+  tally checked(config.producers);
+  std::vector<tally> consumed(config.consumers, tally(config.producers));
+  std::atomic<std::uint32_t> producers_running = config.producers;
+  run stress(config);
+
+  stress.add("push", config.producers, [&](std::uint32_t producer, histogram& latencies) {
+    std::uint64_t sequence = 0;
+    while (!stress.stopping()) {
+      timed(latencies, [&] { queue.push_back(encode(producer, sequence)); });
+      sequence++;
+    }
+    checked.pushed(producer, sequence);
+    producers_running--;
+  });
+
+  stress.add("swap", config.consumers, [&](std::uint32_t consumer, histogram& latencies) {
+    auto drain = [&consumed, consumer](const auto& front) {
+      for (std::uint64_t value : front) {
+        consumed[consumer].seen(value);
+      }
+    };
+
+    while (!stress.stopping() || producers_running.load() > 0 || !queue.is_back_buffer_empty()) {
+      timed(latencies, [&] { queue.swap_buffers(drain); });
+    }
+  });
+
+  stress.add("read", config.readers, [&](std::uint32_t, histogram& latencies) {
+    std::uint64_t checksum = 0;
+    while (!stress.stopping()) {
+      timed(latencies, [&] {
+        queue.lock();
+        const std::size_t size = queue.size();
+        for (std::size_t i = 0; i < std::min<std::size_t>(size, 16); i++) {
+          checksum += queue[i];
+        }
+        queue.unlock();
+      });
+    }
+    static_cast<void>(checksum);
+  });
+
+  stress.start();
+  for (tally& consumer : consumed) {
+    checked.merge(consumer);
+  }
+
+  return stress.report("double_buffer_queue", checked.check());
+}
+
+/// \brief Producers push_back into a vector-like container while readers read random published indices.
+/// \details \p elements is cleared first, so a sweep can reuse it.
+template <typename TContainer>
+outcome stress_vector(const options& config, const std::string& name, TContainer& elements) {
+  elements.clear();
+  tally checked(config.producers);
+  run stress(config);
+
+  stress.add("push", config.producers, [&](std::uint32_t producer, histogram& latencies) {
+    std::uint64_t sequence = 0;
+    while (!stress.stopping()) {
+      bool pushed = true;
+      timed(latencies, [&] {
+        if constexpr (requires { elements.try_push_back(std::uint64_t{}); }) {
+          pushed = elements.try_push_back(encode(producer, sequence));
+        } else {
+          elements.push_back(encode(producer, sequence));
+        }
+      });
+      if (!pushed) {
+        break;
+      }
+      sequence++;
+    }
+    checked.pushed(producer, sequence);
+  });
+
+  std::atomic<std::uint64_t> torn_reads = 0;
+  stress.add("read", config.readers, [&](std::uint32_t reader, histogram& latencies) {
+    std::minstd_rand random(reader + 1);
+    while (!stress.stopping()) {
+      const std::size_t size = elements.size();
+      if (size == 0) {
+        continue;
+      }
+      const std::size_t index = random() % size;
+      const std::uint64_t value = timed(latencies, [&]() -> std::uint64_t { return elements[index]; });
+      if (producer_of(value) >= config.producers) {
+        torn_reads++;
+      }
+    }
+  });
+
+  stress.start();
+  for (std::size_t i = 0; i < elements.size(); i++) {
+    checked.seen(elements[i]);
+  }
+
+  tally::result result = checked.check();
+  result.corrupted += torn_reads.load();
+  return stress.report(name, result);
+}
+
+/// \brief Producers push variable sized records into an arena_queue that consumers swap and drain.
+outcome stress_arena_queue(const options& config) {
+  ccol::arena_queue queue;
+  tally checked(config.producers);
+  tally consumed(config.producers);
+  std::atomic<std::uint32_t> producers_running = config.producers;
+  run stress(config);
+
+  stress.add("push", config.producers, [&](std::uint32_t producer, histogram& latencies) {
+    std::uint64_t sequence = 0;
+    while (!stress.stopping()) {
+      // the payload length varies with the sequence, only the first 8 bytes carry the value
+      const std::uint64_t value = encode(producer, sequence);
+      const std::size_t size = sizeof(value) + sequence % 24;
+      timed(latencies, [&] {
+        queue.emplace(1, size, [value](std::span<std::byte> payload) {
+          std::memcpy(payload.data(), &value, sizeof(value));
+        });
+      });
+      sequence++;
+    }
+    checked.pushed(producer, sequence);
+    producers_running--;
+  });
+
+  // a single consumer, arena_queue has no swap hook so concurrent consumers could clear unread batches
+  stress.add("swap+read", std::min(config.consumers, 1u), [&](std::uint32_t, histogram& latencies) {
+    while (!stress.stopping() || producers_running.load() > 0 || !queue.is_back_buffer_empty()) {
+      timed(latencies, [&] {
+        queue.swap_buffers();
+        queue.lock();
+        for (const auto& message : queue) {
+          std::uint64_t value;
+          std::memcpy(&value, message.payload.data(), sizeof(value));
+          consumed.seen(value);
+        }
+        queue.unlock();
+      });
+    }
+  });
+
+  stress.start();
+  checked.merge(consumed);
+
+  return stress.report("arena_queue", checked.check());
+}
+
+void print_usage() {
+  std::printf(
+      "usage: ConcurrentCollections_Stress [options]\n"
+      "  --container NAME   dbqueue, tvector, svector, stvector, arena or all (default all)\n"
+      "  --producers N      threads pushing elements (default 2)\n"
+      "  --consumers N      threads swapping queue buffers (default 1)\n"
+      "  --readers N        threads reading concurrently (default 2)\n"
+      "  --duration-ms N    how long every container runs (default 1000)\n"
+      "  --pin              pin every thread to a core, round robin\n"
+      "  --sweep N          run with 1, 2, 4 ... N producers and as many readers, then print the\n"
+      "                     throughput of every step\n"
+  );
+}
+
+/// \brief The thread counts of a sweep, powers of two and \p max itself.
+std::vector<std::uint32_t> sweep_steps(std::uint32_t max) {
+  std::vector<std::uint32_t> steps;
+  for (std::uint32_t threads = 1; threads < max; threads *= 2) {
+    steps.push_back(threads);
+  }
+  steps.push_back(max);
+  return steps;
+}
+
+/// \brief One row per container and step, one column per operation.
+void print_sweep(const std::vector<std::tuple<std::string, std::uint32_t, outcome>>& steps) {
+  std::printf("== sweep (ops/s, producers = readers = threads)\n");
+  for (const auto& [container, threads, result] : steps) {
+    std::printf("  %-22s %8u", container.c_str(), threads);
+    for (const auto& [operation, ops_per_second] : result.throughput) {
+      std::printf("  %s %12.0f", operation.c_str(), ops_per_second);
+    }
+    std::printf("%s\n", result.ok ? "" : "  FAILED");
+  }
+}
+
+bool parse(int argc, char** argv, options& config) {
+  for (int i = 1; i < argc; i++) {
+    const std::string_view argument = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (argument == "--pin") {
+      config.pin = true;
+    } else if (argument == "--container" && has_value) {
+      config.container = argv[++i];
+    } else if (argument == "--producers" && has_value) {
+      config.producers = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (argument == "--consumers" && has_value) {
+      config.consumers = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (argument == "--readers" && has_value) {
+      config.readers = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (argument == "--duration-ms" && has_value) {
+      config.duration = std::chrono::milliseconds(std::strtoull(argv[++i], nullptr, 10));
+    } else if (argument == "--sweep" && has_value) {
+      config.sweep = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+      if (config.sweep == 0) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+  return config.producers > 0 && config.consumers > 0;
+}
+
+}  // namespace ccol::stress
+
+int main(int argc, char** argv) {
+  using namespace ccol::stress;
+
+  options config;
+  if (!parse(argc, argv, config)) {
+    print_usage();
+    return 2;
+  }
+
+#if defined(CCOL_STRESS_TSAN)
+  std::printf("built with ThreadSanitizer, latencies include its overhead\n");
+#endif
+  std::printf(
+      "producers %u, consumers %u, readers %u, %lld ms per container%s\n",
+      config.producers,
+      config.consumers,
+      config.readers,
+      static_cast<long long>(config.duration.count()),
+      config.pin ? ", pinned" : ""
+  );
+
+  // static_trivial_vector is too big for the stack
+  static ccol::static_trivial_vector<std::uint64_t, 1 << 22> static_elements;
+  ccol::trivial_vector<std::uint64_t> trivial_elements;
+  ccol::sparse_vector<std::uint64_t, 1024> sparse_elements;
+
+  const std::map<std::string, std::function<outcome()>> containers{
+      {"dbqueue", [&] { return stress_double_buffer_queue(config); }},
+      {"tvector", [&] { return stress_vector(config, "trivial_vector", trivial_elements); }},
+      {"svector", [&] { return stress_vector(config, "sparse_vector", sparse_elements); }},
+      {"stvector", [&] { return stress_vector(config, "static_trivial_vector", static_elements); }},
+      {"arena", [&] { return stress_arena_queue(config); }},
+  };
+
+  if (config.container != "all" && !containers.contains(config.container)) {
+    print_usage();
+    return 2;
+  }
+
+  bool ok = true;
+  std::vector<std::tuple<std::string, std::uint32_t, outcome>> sweep;
+  for (std::uint32_t threads : config.sweep > 0 ? sweep_steps(config.sweep) : std::vector<std::uint32_t>{0}) {
+    if (config.sweep > 0) {
+      config.producers = threads;
+      config.readers = threads;
+      std::printf("-- %u producers, %u readers\n", threads, threads);
+    }
+
+    for (const auto& [name, stress] : containers) {
+      if (config.container == "all" || config.container == name) {
+        outcome result = stress();
+        ok = result.ok && ok;
+        if (config.sweep > 0) {
+          sweep.emplace_back(name, threads, std::move(result));
+        }
+      }
+    }
+  }
+
+  if (config.sweep > 0) {
+    print_sweep(sweep);
+  }
+  return ok ? 0 : 1;
+}
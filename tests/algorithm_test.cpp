@@ -0,0 +1,89 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+#include <catch2/catch_all.hpp>
+#include <ccol/algorithm.h>
+#include <ccol/static_trivial_vector.h>
+#include <ccol/trivial_vector.h>
+
+TEMPLATE_TEST_CASE(
+    "Algorithm Bulk Kernels", "[algorithm]", std::int32_t, std::uint32_t, float, std::uint8_t, std::uint64_t
+) {
+  ccol::trivial_vector<TestType> elements;
+
+  SECTION("Empty") {
+    CHECK(!ccol::find(elements, TestType{1}).has_value());
+    CHECK(ccol::count(elements, TestType{1}) == 0);
+    CHECK(!ccol::min_value(elements).has_value());
+    CHECK(!ccol::max_value(elements).has_value());
+    CHECK(ccol::sum(elements) == TestType{0});
+  }
+
+  SECTION("Values") {
+    // an odd size so both the vector and the scalar tail are exercised
+    for (std::uint32_t i = 0; i < 37; i++) {
+      elements.push_back(static_cast<TestType>(i % 20 + 5));
+    }
+
+    CHECK(ccol::find(elements, TestType{5}) == 0);
+    CHECK(ccol::find(elements, TestType{24}) == 19);
+    CHECK(ccol::find(elements, TestType{21}) == 16);
+    CHECK(!ccol::find(elements, TestType{100}).has_value());
+    CHECK(ccol::count(elements, TestType{10}) == 2);
+    CHECK(ccol::count(elements, TestType{24}) == 1);
+    CHECK(ccol::min_value(elements) == TestType{5});
+    CHECK(ccol::max_value(elements) == TestType{24});
+
+    TestType expected_sum{0};
+    for (std::uint32_t i = 0; i < 37; i++) {
+      expected_sum = static_cast<TestType>(expected_sum + static_cast<TestType>(i % 20 + 5));
+    }
+    CHECK(ccol::sum(elements) == expected_sum);
+
+    ccol::transform_inplace(elements, [](TestType value) { return static_cast<TestType>(value + 1); });
+    CHECK(elements[0] == TestType{6});
+    CHECK(ccol::max_value(elements) == TestType{25});
+
+    ccol::fill(elements, TestType{3});
+    CHECK(ccol::count(elements, TestType{3}) == 37);
+    CHECK(elements.size() == 37);
+  }
+}
+
+TEST_CASE("Algorithm Static Vector", "[algorithm]") {
+  ccol::static_trivial_vector<std::int32_t, 64> elements{-4, 8, -15, 16, 23, 42, 0, 7, 9};
+
+  CHECK(ccol::find(elements, 42) == 5);
+  CHECK(ccol::min_value(elements) == -15);
+  CHECK(ccol::max_value(elements) == 42);
+  CHECK(ccol::sum(elements) == 86);
+}
+
+TEST_CASE("Algorithm Unsigned Range", "[algorithm]") {
+  // values past the signed range catch kernels that compare unsigned lanes as signed
+  ccol::static_trivial_vector<std::uint32_t, 16> elements{7, 0x80000000u, 3, 0xFFFFFFF0u, 1, 0x7FFFFFFFu, 9, 2, 5};
+
+  CHECK(ccol::min_value(elements) == 1u);
+  CHECK(ccol::max_value(elements) == 0xFFFFFFF0u);
+  CHECK(ccol::find(elements, 0xFFFFFFF0u) == 3);
+}
+
+TEST_CASE("Algorithm Benchmark", "[algorithm][!benchmark]") {
+  ccol::trivial_vector<std::uint32_t> ids;
+  ids.resize(1000000);
+  ccol::transform_inplace(ids, [i = 0u](std::uint32_t) mutable { return i++; });
+
+  BENCHMARK("Find Last (bulk)") {
+    return ccol::find(ids, 999999u);
+  };
+
+  BENCHMARK("Find Last (per element)") {
+    for (std::uint32_t i = 0; i < ids.size(); i++) {
+      if (ids[i] == 999999u) {
+        return i;
+      }
+    }
+    return 0u;
+  };
+}
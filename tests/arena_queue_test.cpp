@@ -0,0 +1,166 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+#include <catch2/catch_all.hpp>
+#include <ccol/arena_queue.h>
+
+#include <barrier>
+
+namespace {
+
+enum MessageType : std::uint32_t {
+  kMove = 1,
+  kDamage = 2,
+  kChat = 3,
+};
+
+struct MoveMessage {
+  std::uint32_t entity;
+  float x;
+  float y;
+};
+
+struct DamageMessage {
+  std::uint64_t entity;
+  double amount;
+};
+
+}  // namespace
+
+TEST_CASE("ArenaQueue Basic Operations", "[arenaqueue]") {
+  ccol::arena_queue queue;
+
+  SECTION("Mixed Messages") {
+    const std::string chat = "hello";
+    queue.push(kMove, MoveMessage{1, 2.0f, 3.0f});
+    queue.push(kChat, std::as_bytes(std::span(chat)));
+    queue.push(kDamage, DamageMessage{4, 5.5});
+
+    CHECK(queue.size() == 0);  // NOLINT(*-container-size-empty)
+    CHECK(!queue.is_back_buffer_empty());
+
+    queue.swap_buffers();
+    CHECK(queue.is_back_buffer_empty());
+
+    queue.lock();
+    REQUIRE(queue.size() == 3);
+
+    auto it = queue.begin();
+    CHECK((*it).type == kMove);
+    CHECK((*it).as<MoveMessage>().entity == 1);
+    CHECK((*it).as<MoveMessage>().y == 3.0f);
+
+    ++it;
+    CHECK((*it).type == kChat);
+    const auto text = (*it).payload;
+    CHECK(std::string(reinterpret_cast<const char*>(text.data()), text.size()) == "hello");
+
+    ++it;
+    CHECK((*it).type == kDamage);
+    CHECK((*it).as<DamageMessage>().amount == 5.5);
+    CHECK(reinterpret_cast<std::uintptr_t>((*it).payload.data()) % alignof(DamageMessage) == 0);
+
+    ++it;
+    CHECK(it == queue.end());
+    queue.unlock();
+  }
+
+  SECTION("Emplace In Place") {
+    queue.emplace(kChat, 4, [](std::span<std::byte> payload) {
+      std::fill(payload.begin(), payload.end(), std::byte{7});
+    });
+    queue.swap_buffers();
+
+    queue.lock();
+    REQUIRE(queue.size() == 1);
+    for (const auto& message : queue) {
+      CHECK(message.payload.size() == 4);
+      CHECK(message.payload[3] == std::byte{7});
+    }
+    queue.unlock();
+  }
+
+  SECTION("Oversize Payload") {
+    bool writer_called = false;
+    auto writer = [&writer_called](std::span<std::byte>) { writer_called = true; };
+    CHECK_THROWS_AS(queue.emplace(kChat, ccol::arena_queue::max_payload_size + 1, writer), std::length_error);
+    CHECK(!writer_called);
+    CHECK(queue.is_back_buffer_empty());
+  }
+
+  SECTION("Mismatched Type Tag") {
+    queue.push(kChat, std::uint32_t{7});
+    queue.swap_buffers();
+
+    queue.lock();
+    REQUIRE(queue.size() == 1);
+    const auto message = *queue.begin();
+    CHECK(message.as<std::uint32_t>() == 7);
+    CHECK_THROWS_AS(message.as<DamageMessage>(), std::length_error);
+    queue.unlock();
+  }
+
+  SECTION("Arena Reuse") {
+    auto push_batch = [&queue]() {
+      for (std::uint32_t i = 0; i < 100; i++) {
+        queue.push(kMove, MoveMessage{i, 0.0f, 0.0f});
+      }
+      queue.swap_buffers();
+    };
+
+    push_batch();
+    push_batch();
+    const std::size_t warm_bytes = ccol::allocated_bytes();
+    const std::size_t warm_memory = queue.memory_bytes();
+
+    for (std::uint32_t i = 0; i < 10; i++) {
+      push_batch();
+    }
+
+    CHECK(ccol::allocated_bytes() == warm_bytes);
+    CHECK(queue.memory_bytes() == warm_memory);
+
+    queue.swap_buffers();
+    queue.shrink_to_fit();
+    CHECK(queue.memory_bytes() < warm_memory);
+  }
+}
+
+TEST_CASE("ArenaQueue MT Access", "[arenaqueue]") {
+  ccol::arena_queue queue;
+  std::barrier sync_point(3);
+
+  {
+    auto push = [&queue, &sync_point](std::uint32_t entity) {
+      sync_point.arrive_and_wait();
+      for (std::uint32_t i = 0; i < 10000; i++) {
+        if (i % 2 == 0) {
+          queue.push(kMove, MoveMessage{entity, static_cast<float>(i), 0.0f});
+        } else {
+          queue.push(kDamage, DamageMessage{entity, static_cast<double>(i)});
+        }
+      }
+    };
+
+    std::jthread push_thread_1(push, 1);
+    std::jthread push_thread_2(push, 2);
+    sync_point.arrive_and_wait();
+  }
+
+  queue.swap_buffers();
+  queue.lock();
+  CHECK(queue.size() == 20000);
+  std::size_t moves = 0;
+  for (const auto& message : queue) {
+    if (message.type == kMove) {
+      moves++;
+      CHECK(message.as<MoveMessage>().entity > 0);
+    } else {
+      CHECK(message.type == kDamage);
+      CHECK(message.as<DamageMessage>().entity > 0);
+    }
+  }
+  CHECK(moves == 10000);
+  queue.unlock();
+}
@@ -0,0 +1,136 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+#include <catch2/catch_all.hpp>
+#include <ccol/batch_log.h>
+
+#include <fstream>
+#include <random>
+#include <string>
+
+namespace {
+
+/// \brief A temp file name of its own, so test runs that happen at the same time don't share a log.
+std::filesystem::path unique_log_path() {
+  std::random_device random;
+  const auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+  return std::filesystem::temp_directory_path() /
+         ("ccol_batch_log_test_" + std::to_string(random()) + "_" + std::to_string(now) + ".bin");
+}
+
+}  // namespace
+
+TEST_CASE("BatchLog Record And Read", "[batchlog]") {
+  const std::filesystem::path log_path = unique_log_path();
+
+  {
+    ccol::double_buffer_queue<std::uint32_t> queue;
+    ccol::batch_log_writer<std::uint32_t> recorder(log_path);
+    REQUIRE(recorder.is_open());
+
+    auto record = [&recorder](const auto& front) { recorder.record(front); };
+
+    queue.append(std::array<std::uint32_t, 3>{0, 1, 2});
+    queue.swap_buffers(record);
+
+    queue.swap_buffers(record);
+
+    queue.push_back(3);
+    queue.push_back(4);
+    queue.swap_buffers(record);
+  }
+
+  SECTION("Read Batches") {
+    ccol::batch_log_reader<std::uint32_t> reader(log_path);
+    REQUIRE(reader.is_open());
+
+    std::vector<std::vector<std::uint32_t>> batches;
+    std::chrono::nanoseconds last_timestamp{0};
+    for (const auto& batch : reader) {
+      CHECK(batch.timestamp >= last_timestamp);
+      last_timestamp = batch.timestamp;
+      batches.emplace_back(batch.elements.begin(), batch.elements.end());
+    }
+
+    REQUIRE(batches.size() == 3);
+    CHECK(batches[0] == std::vector<std::uint32_t>{0, 1, 2});
+    CHECK(batches[1].empty());
+    CHECK(batches[2] == std::vector<std::uint32_t>{3, 4});
+  }
+
+  SECTION("Replay Into Queue") {
+    ccol::batch_log_reader<std::uint32_t> reader(log_path);
+    ccol::double_buffer_queue<std::uint32_t> queue;
+    reader.replay(queue, ccol::replay_speed::full_speed);
+    queue.swap_buffers();
+
+    queue.lock();
+    REQUIRE(queue.size() == 5);
+    for (std::uint32_t i = 0; i < queue.size(); i++) {
+      CHECK(queue[i] == i);
+    }
+    queue.unlock();
+  }
+
+  SECTION("Element Size Mismatch") {
+    ccol::batch_log_reader<std::uint64_t> reader(log_path);
+    CHECK(!reader.is_open());
+    CHECK(reader.begin() == reader.end());
+  }
+
+  SECTION("Truncated Log") {
+    const auto full_size = std::filesystem::file_size(log_path);
+    std::filesystem::resize_file(log_path, full_size - 4);
+
+    ccol::batch_log_reader<std::uint32_t> reader(log_path);
+    REQUIRE(reader.is_open());
+    CHECK(std::distance(reader.begin(), reader.end()) == 2);
+  }
+
+  std::filesystem::remove(log_path);
+}
+
+TEST_CASE("BatchLog Replay Timing", "[batchlog]") {
+  using namespace std::chrono_literals;
+  const std::filesystem::path log_path = unique_log_path();
+
+  {
+    ccol::batch_log_writer<std::uint32_t> recorder(log_path);
+    REQUIRE(recorder.is_open());
+
+    // the recorder sits idle before the first batch, replay shouldn't wait that out
+    std::this_thread::sleep_for(300ms);
+    recorder.record(std::array<std::uint32_t, 1>{0});
+    std::this_thread::sleep_for(20ms);
+    recorder.record(std::array<std::uint32_t, 1>{1});
+  }
+
+  ccol::batch_log_reader<std::uint32_t> reader(log_path);
+  ccol::double_buffer_queue<std::uint32_t> queue;
+  const auto start = std::chrono::steady_clock::now();
+  reader.replay(queue, ccol::replay_speed::original_rate);
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  CHECK(elapsed >= 20ms);
+  CHECK(elapsed < 300ms);
+
+  std::filesystem::remove(log_path);
+}
+
+#if defined(__linux__)
+TEST_CASE("BatchLog Write Errors", "[batchlog]") {
+  // every write to /dev/full fails with ENOSPC
+  ccol::batch_log_writer<std::uint32_t> recorder("/dev/full");
+  REQUIRE(recorder.is_open());
+
+  recorder.record(std::array<std::uint32_t, 3>{0, 1, 2});
+  recorder.flush();
+  CHECK(!recorder.good());
+
+  // errors are sticky
+  recorder.record(std::array<std::uint32_t, 1>{3});
+  recorder.flush();
+  CHECK(!recorder.good());
+  CHECK(recorder.is_open());
+}
+#endif
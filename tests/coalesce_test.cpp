@@ -0,0 +1,115 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+#include <catch2/catch_all.hpp>
+#include <ccol/coalesce.h>
+#include <ccol/double_buffer_queue.h>
+
+#include <map>
+#include <random>
+
+namespace {
+
+struct Update {
+  std::uint32_t entity;
+  std::int32_t delta;
+};
+
+struct SignedUpdate {
+  std::int64_t key;
+  std::uint32_t order;
+};
+
+auto entity_of = [](const Update& update) { return update.entity; };
+auto add_delta = [](Update& into, const Update& newer) { into.delta += newer.delta; };
+
+}  // namespace
+
+TEST_CASE("Coalesce Stage", "[coalesce]") {
+  SECTION("Small Batch In Swap") {
+    ccol::double_buffer_queue<Update> queue;
+    auto stage = ccol::make_coalesce_stage<Update>(entity_of, add_delta);
+
+    queue.push_back({3, 1});
+    queue.push_back({1, 2});
+    queue.push_back({3, 4});
+    queue.push_back({2, 8});
+    queue.push_back({1, 16});
+    queue.swap_buffers(stage);
+
+    queue.lock();
+    REQUIRE(queue.size() == 3);
+    CHECK(queue[0].entity == 1);
+    CHECK(queue[0].delta == 18);
+    CHECK(queue[1].entity == 2);
+    CHECK(queue[1].delta == 8);
+    CHECK(queue[2].entity == 3);
+    CHECK(queue[2].delta == 5);
+    queue.unlock();
+  }
+
+  SECTION("Stable For Signed Keys") {
+    std::vector<SignedUpdate> values{{5, 0}, {-3, 1}, {5, 2}, {-300000, 3}, {0, 4}, {-3, 5}};
+    std::vector<std::uint32_t> merged_order;
+    auto stage = ccol::make_coalesce_stage<SignedUpdate>(
+        [](const SignedUpdate& update) { return update.key; },
+        [&merged_order](SignedUpdate& into, const SignedUpdate& newer) {
+          merged_order.push_back(into.order);
+          merged_order.push_back(newer.order);
+        }
+    );
+
+    const std::size_t merged_size = stage.coalesce(values);
+    REQUIRE(merged_size == 4);
+    CHECK(values[0].key == -300000);
+    CHECK(values[1].key == -3);
+    CHECK(values[2].key == 0);
+    CHECK(values[3].key == 5);
+    CHECK(merged_order == std::vector<std::uint32_t>{1, 5, 0, 2});
+  }
+
+  SECTION("Parallel Large Batch") {
+    constexpr std::size_t batch_size = 200000;
+    std::mt19937 random(42);
+    std::uniform_int_distribution<std::uint32_t> entities(0, 50000);
+
+    ccol::trivial_vector<Update> batch;
+    std::map<std::uint32_t, std::int32_t> expected;
+    for (std::size_t i = 0; i < batch_size; i++) {
+      const Update update{entities(random), static_cast<std::int32_t>(i % 7)};
+      batch.push_back(update);
+      expected[update.entity] += update.delta;
+    }
+
+    auto stage = ccol::make_coalesce_stage<Update>(entity_of, add_delta, 4, 1024);
+    stage(batch);
+
+    REQUIRE(batch.size() == expected.size());
+    std::size_t index = 0;
+    for (const auto& [entity, delta] : expected) {
+      const Update update = batch[index++];
+      REQUIRE(update.entity == entity);
+      REQUIRE(update.delta == delta);
+    }
+  }
+
+  SECTION("Worker Pool Reused Across Batches") {
+    // a threshold below the worker count leaves some workers with empty slices
+    auto stage = ccol::make_coalesce_stage<Update>(entity_of, add_delta, 4, 2);
+    for (std::uint32_t round = 0; round < 50; round++) {
+      const std::uint32_t batch_size = round % 2 == 0 ? 3 : 5000;
+      ccol::trivial_vector<Update> batch;
+      for (std::uint32_t i = 0; i < batch_size; i++) {
+        batch.push_back({(batch_size - i) % 100, 1});
+      }
+
+      stage(batch);
+      REQUIRE(batch.size() == std::min(batch_size, 100u));
+      for (std::uint32_t i = 0; i < batch.size(); i++) {
+        REQUIRE(batch[i].entity == (batch_size < 100 ? batch_size - batch.size() + 1 + i : i));
+        REQUIRE(batch[i].delta == static_cast<std::int32_t>(batch_size < 100 ? 1 : batch_size / 100));
+      }
+    }
+  }
+}
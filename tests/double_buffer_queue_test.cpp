@@ -6,6 +6,7 @@
 #include <ccol/double_buffer_queue.h>
 
 #include <barrier>
+#include <coroutine>
 
 struct ComplexObject {
   std::uint32_t x;
@@ -55,6 +56,200 @@ TEST_CASE("DoubleBufferQueue Basic Operations", "[dbqueue]") {
 
 }
 
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+struct ManualScheduler {
+  void schedule(std::coroutine_handle<> handle) { ready.push_back(handle); }
+
+  void run() {
+    while (!ready.empty()) {
+      std::coroutine_handle<> handle = ready.front();
+      ready.erase(ready.begin());
+      handle.resume();
+    }
+  }
+
+  std::vector<std::coroutine_handle<>> ready;
+};
+
+TEST_CASE("DoubleBufferQueue Coroutines", "[dbqueue]") {
+  ManualScheduler scheduler;
+
+  SECTION("Next Batch") {
+    ccol::double_buffer_queue<std::uint32_t> queue;
+    std::vector<std::uint32_t> received;
+
+    auto consumer = [&]() -> DetachedTask {
+      auto batch = co_await queue.next_batch(scheduler);
+      for (std::uint32_t value : batch) {
+        received.push_back(value);
+      }
+    };
+
+    consumer();
+    CHECK(scheduler.ready.empty());
+    CHECK(received.empty());
+
+    queue.push_back(1);
+    queue.push_back(2);
+    CHECK(scheduler.ready.size() == 1);
+
+    scheduler.run();
+    CHECK(received == std::vector<std::uint32_t>{1, 2});
+  }
+
+  SECTION("Next Batch Ready") {
+    ccol::double_buffer_queue<std::uint32_t> queue;
+    queue.push_back(7);
+    std::size_t received = 0;
+
+    auto consumer = [&]() -> DetachedTask {
+      auto batch = co_await queue.next_batch(scheduler);
+      received = batch.size();
+    };
+
+    consumer();
+    CHECK(received == 1);
+    CHECK(scheduler.ready.empty());
+  }
+
+  SECTION("Next Batch Reusing The Guard") {
+    ccol::double_buffer_queue<std::uint32_t> queue;
+    std::vector<std::uint32_t> received;
+
+    auto consumer = [&]() -> DetachedTask {
+      auto batch = co_await queue.next_batch(scheduler);
+      while (true) {
+        for (std::uint32_t value : batch) {
+          received.push_back(value);
+        }
+        if (received.size() == 3) {
+          co_return;
+        }
+        // the previous batch is released before the swap, so this can't wait on our own read lock
+        batch = co_await queue.next_batch(scheduler, batch);
+      }
+    };
+
+    for (std::uint32_t value = 1; value <= 3; value++) {
+      queue.push_back(value);
+      if (value == 1) {
+        consumer();
+      } else {
+        scheduler.run();
+      }
+    }
+    CHECK(received == std::vector<std::uint32_t>{1, 2, 3});
+    queue.swap_buffers();  // the last batch was released too
+  }
+
+  SECTION("Bounded Push") {
+    ccol::double_buffer_queue<std::uint32_t> queue(2);
+    bool finished = false;
+
+    auto producer = [&]() -> DetachedTask {
+      for (std::uint32_t i = 0; i < 3; i++) {
+        co_await queue.push(i, scheduler);
+      }
+      finished = true;
+    };
+
+    producer();
+    CHECK(!finished);
+    CHECK(!queue.try_push_back(3));
+
+    queue.swap_buffers();
+    CHECK(scheduler.ready.size() == 1);
+    scheduler.run();
+    CHECK(finished);
+
+    queue.lock();
+    CHECK(queue.size() == 2);
+    CHECK(queue[0] == 0);
+    CHECK(queue[1] == 1);
+    queue.unlock();
+
+    queue.swap_buffers();
+    queue.lock();
+    CHECK(queue.size() == 1);
+    CHECK(queue[0] == 2);
+    queue.unlock();
+  }
+}
+
+struct InlineScheduler {
+  void schedule(std::coroutine_handle<> handle) { handle.resume(); }
+};
+
+TEST_CASE("DoubleBufferQueue Concurrent Consumers", "[dbqueue]") {
+  constexpr std::uint32_t value_count = 100000;
+  constexpr std::uint32_t stop_value = std::numeric_limits<std::uint32_t>::max();
+
+  ccol::double_buffer_queue<std::uint32_t> queue;
+  InlineScheduler scheduler;
+  std::array<std::vector<std::uint32_t>, 2> received;
+  std::atomic<std::uint32_t> finished = 0;
+
+  auto consumer = [&](std::vector<std::uint32_t>& values) -> DetachedTask {
+    bool stopping = false;
+    while (!stopping) {
+      auto batch = co_await queue.next_batch(scheduler);
+      for (std::uint32_t value : batch) {
+        if (value == stop_value) {
+          stopping = true;
+        } else {
+          values.push_back(value);
+        }
+      }
+    }
+    finished++;
+  };
+
+  {
+    std::barrier sync_point(4);
+    std::jthread first_consumer([&] {
+      sync_point.arrive_and_wait();
+      consumer(received[0]);
+    });
+    std::jthread second_consumer([&] {
+      sync_point.arrive_and_wait();
+      consumer(received[1]);
+    });
+
+    // two producers, so consumers get resumed and swap from different threads at once
+    auto produce = [&](std::uint32_t first) {
+      sync_point.arrive_and_wait();
+      for (std::uint32_t i = first; i < value_count; i += 2) {
+        queue.push_back(i);
+      }
+    };
+    std::jthread producer(produce, 1);
+    produce(0);
+  }
+
+  // a consumer can take several stop values in one batch, keep pushing until both are done
+  while (finished < 2) {
+    queue.push_back(stop_value);
+    std::this_thread::yield();
+  }
+
+  std::vector<std::uint32_t> all(received[0].begin(), received[0].end());
+  all.insert(all.end(), received[1].begin(), received[1].end());
+  std::sort(all.begin(), all.end());
+  REQUIRE(all.size() == value_count);
+  for (std::uint32_t i = 0; i < value_count; i++) {
+    CHECK(all[i] == i);
+  }
+}
+
 TEST_CASE("DoubleBufferQueue MT Access", "[dbqueue][!mayfail][!throws]") {
   ccol::double_buffer_queue<std::uint32_t> queue;
   std::barrier sync_point(2);
@@ -0,0 +1,289 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+#include <catch2/catch_all.hpp>
+#include <ccol/epoch.h>
+#include <ccol/soa_vector.h>
+#include <ccol/sparse_vector.h>
+#include <ccol/trivial_vector.h>
+
+#include <barrier>
+#include <semaphore>
+#include <string>
+
+namespace {
+
+std::atomic<std::size_t> deleted_count = 0;
+
+void count_deletion(void*, std::size_t count) { deleted_count += count; }
+
+}  // namespace
+
+TEST_CASE("Epoch Reclamation", "[epoch]") {
+  deleted_count = 0;
+  int dummy = 0;
+
+  SECTION("Retire Without Readers") {
+    ccol::epoch::retire(&dummy, 1, count_deletion);
+    CHECK(deleted_count == 1);
+    CHECK(ccol::epoch::pending() == 0);
+  }
+
+  SECTION("Nested Guards") {
+    CHECK(!ccol::epoch::is_pinned());
+    {
+      const ccol::epoch::guard _outer;
+      {
+        const ccol::epoch::guard _inner;
+        CHECK(ccol::epoch::is_pinned());
+      }
+      CHECK(ccol::epoch::is_pinned());
+
+      // retiring while pinned waits for our own guard
+      ccol::epoch::retire(&dummy, 1, count_deletion);
+      CHECK(deleted_count == 0);
+      CHECK(ccol::epoch::pending() == 1);
+    }
+    CHECK(!ccol::epoch::is_pinned());
+
+    ccol::epoch::collect();
+    CHECK(deleted_count == 1);
+    CHECK(ccol::epoch::pending() == 0);
+  }
+
+  SECTION("Readers Help Collecting") {
+    std::binary_semaphore pinned{0};
+    std::binary_semaphore retired{0};
+    std::jthread reader([&] {
+      {
+        const ccol::epoch::guard _pinned;
+        pinned.release();
+        retired.acquire();
+      }
+
+      // only every few unpins help, so a reader doing lookups eventually frees what the writer left behind
+      for (std::uint32_t i = 0; i < ccol::epoch::detail::domain::reader_collect_interval; i++) {
+        const ccol::epoch::guard _lookup;
+      }
+    });
+
+    pinned.acquire();
+    ccol::epoch::retire(&dummy, 1, count_deletion);
+    CHECK(deleted_count == 0);
+    retired.release();
+    reader.join();
+    CHECK(deleted_count == 1);
+    CHECK(ccol::epoch::pending() == 0);
+  }
+
+  SECTION("Retire Waits For Pinned Readers") {
+    std::binary_semaphore pinned{0};
+    std::binary_semaphore retired{0};
+    std::jthread reader([&] {
+      const ccol::epoch::guard _pinned;
+      pinned.release();
+      retired.acquire();
+    });
+
+    pinned.acquire();
+    ccol::epoch::retire(&dummy, 1, count_deletion);
+    CHECK(ccol::epoch::collect() == 0);
+    CHECK(deleted_count == 0);
+
+    retired.release();
+    reader.join();
+    ccol::epoch::collect();
+    CHECK(deleted_count == 1);
+    CHECK(ccol::epoch::pending() == 0);
+  }
+
+  SECTION("Exited Threads Don't Block") {
+    for (std::uint32_t i = 0; i < 8; i++) {
+      std::jthread([] { const ccol::epoch::guard _pinned; }).join();
+    }
+
+    ccol::epoch::retire(&dummy, 1, count_deletion);
+    CHECK(deleted_count == 1);
+  }
+}
+
+TEST_CASE("Epoch Protected Containers", "[epoch]") {
+  SECTION("Trivial Vector Reallocates Under A Reader") {
+    ccol::trivial_vector<std::uint32_t> elements;
+    for (std::uint32_t i = 0; i < 16; i++) {
+      elements.push_back(i);
+    }
+
+    std::binary_semaphore reading{0};
+    std::binary_semaphore grown{0};
+    std::size_t read_size = 0;
+    std::uint32_t mismatches = 0;
+    std::jthread reader([&] {
+      elements.read([&](std::span<const std::uint32_t> values) {
+        reading.release();
+        grown.acquire();
+
+        // the span still points into the buffer that was replaced
+        read_size = values.size();
+        for (std::uint32_t i = 0; i < values.size(); i++) {
+          mismatches += values[i] == i ? 0 : 1;
+        }
+      });
+    });
+
+    reading.acquire();
+    for (std::uint32_t i = 16; i < 1024; i++) {
+      elements.push_back(i);
+    }
+    elements.shrink_to_fit();
+    CHECK(ccol::epoch::pending() > 0);
+
+    grown.release();
+    reader.join();
+    CHECK(read_size == 16);
+    CHECK(mismatches == 0);
+    ccol::epoch::collect();
+    CHECK(ccol::epoch::pending() == 0);
+    CHECK(elements.size() == 1024);
+    CHECK(elements[1023] == 1023);
+  }
+
+  SECTION("Sparse Vector Frees Under A Reader") {
+    const std::size_t bytes_before = ccol::allocated_bytes();
+    {
+      ccol::sparse_vector<std::uint32_t, 8> elements;
+      for (std::uint32_t i = 0; i < 32; i++) {
+        elements.push_back(i);
+      }
+
+      const ccol::epoch::guard _pinned;
+      const std::uint32_t& element = std::as_const(elements)[20];
+      elements.free();
+      CHECK(elements.size() == 0);  // NOLINT(*-container-size-empty)
+      CHECK(element == 20);
+      CHECK(ccol::allocated_bytes() > bytes_before);
+    }
+
+    ccol::epoch::collect();
+    CHECK(ccol::allocated_bytes() == bytes_before);
+  }
+
+  SECTION("SoA Vector Frees Under A Reader") {
+    const std::size_t bytes_before = ccol::allocated_bytes();
+    {
+      ccol::soa_vector<8, std::uint32_t, float> elements;
+      for (std::uint32_t i = 0; i < 32; i++) {
+        elements.push_back(i, static_cast<float>(i));
+      }
+
+      const ccol::epoch::guard _pinned;
+      const std::span<const std::uint32_t> column = std::as_const(elements).column<0>(2);
+      elements.trim();
+      elements.clear();
+      elements.trim();
+      CHECK(elements.capacity() == 0);
+      CHECK(column[4] == 20);
+      CHECK(ccol::allocated_bytes() > bytes_before);
+    }
+
+    ccol::epoch::collect();
+    CHECK(ccol::allocated_bytes() == bytes_before);
+  }
+
+  SECTION("Stale Indices After Free") {
+    ccol::sparse_vector<std::string, 8> strings;
+    ccol::soa_vector<8, std::uint32_t> columns;
+    for (std::uint32_t i = 0; i < 32; i++) {
+      strings.push_back(std::to_string(i));
+      columns.push_back(i);
+    }
+
+    const ccol::epoch::guard _pinned;
+    REQUIRE(5 < strings.size());
+    REQUIRE(5 < columns.size());
+
+    // the page table is reallocated, the stale index must not reach the new one
+    strings.free();
+    strings.shrink_to_fit();
+    columns.free();
+    columns.shrink_to_fit();
+    CHECK_THROWS_AS(strings[5], std::out_of_range);
+    CHECK_THROWS_AS(columns.get<0>(5), std::out_of_range);
+    CHECK_THROWS_AS(columns.column<0>(0), std::out_of_range);
+    std::size_t visited_pages = 0;
+    columns.for_each_page<0>([&visited_pages](std::span<std::uint32_t>) { visited_pages++; });
+    CHECK(visited_pages == 0);
+
+    // a fresh page only holds the elements pushed into it
+    strings.push_back("fresh");
+    CHECK(strings[0] == "fresh");
+    CHECK_THROWS_AS(strings[5], std::out_of_range);
+  }
+
+  SECTION("Destructors Don't Wait For Readers") {
+    static std::atomic<std::uint32_t> destroyed = 0;
+    struct counted {
+      counted() = default;
+      counted(const counted&) = default;
+      counted& operator=(const counted&) = default;
+      ~counted() { destroyed++; }
+    };
+
+    destroyed = 0;
+    const ccol::epoch::guard _pinned;
+    std::size_t bytes_alive = 0;
+    std::size_t soa_capacity = 0;
+    {
+      ccol::sparse_vector<counted, 8> sparse_elements;
+      ccol::soa_vector<8, std::uint32_t> soa_elements;
+      for (std::uint32_t i = 0; i < 32; i++) {
+        sparse_elements.push_back(counted{});
+        soa_elements.push_back(i);
+      }
+      destroyed = 0;
+      bytes_alive = ccol::allocated_bytes();
+      soa_capacity = soa_elements.capacity();
+    }
+
+    // the pages go with the vectors, only the page tables they outgrew wait for the guard
+    CHECK(destroyed == 32);
+    CHECK(bytes_alive - ccol::allocated_bytes() >= soa_capacity * sizeof(std::uint32_t));
+  }
+
+  SECTION("Readers And Writers") {
+    ccol::trivial_vector<std::uint64_t> elements;
+    std::atomic<bool> done = false;
+    std::atomic<std::uint64_t> mismatches = 0;
+    std::barrier sync_point(3);
+
+    std::jthread writer([&] {
+      sync_point.arrive_and_wait();
+      for (std::uint64_t i = 0; i < 20000; i++) {
+        elements.push_back(i);
+        if (i % 4096 == 0) {
+          elements.shrink_to_fit();
+        }
+      }
+      done = true;
+    });
+
+    auto read_all = [&] {
+      sync_point.arrive_and_wait();
+      while (!done) {
+        elements.read([&mismatches](std::span<const std::uint64_t> values) {
+          for (std::size_t i = 0; i < values.size(); i++) {
+            mismatches += values[i] == i ? 0 : 1;
+          }
+        });
+      }
+    };
+    std::jthread reader(read_all);
+    read_all();
+
+    reader.join();
+    writer.join();
+    CHECK(mismatches == 0);
+    CHECK(elements.size() == 20000);
+  }
+}
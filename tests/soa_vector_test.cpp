@@ -0,0 +1,123 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+#include <catch2/catch_all.hpp>
+#include <ccol/soa_vector.h>
+
+#include <barrier>
+
+TEST_CASE("SoaVector Basic Operations", "[soavector]") {
+  SECTION("Fields") {
+    ccol::soa_vector<4, std::uint32_t, float, std::string> elements;
+    CHECK(elements.push_back(0, 0.5f, "0") == 0);
+    CHECK(elements.emplace_back(1, 1.5f, "1") == 1);
+    elements.push_back(2, 2.5f, "2");
+
+    CHECK(elements.size() == 3);  // NOLINT(*-container-size-empty)
+    CHECK(elements.get<0>(2) == 2);
+    CHECK(elements.get<1>(1) == 1.5f);
+    CHECK(elements.get<2>(0) == "0");
+
+    auto [id, weight, name] = elements[1];
+    CHECK(id == 1);
+    CHECK(weight == 1.5f);
+    CHECK(name == "1");
+
+    std::get<0>(elements[1]) = 10;
+    CHECK(elements.get<0>(1) == 10);
+  }
+
+  SECTION("Page Columns") {
+    ccol::soa_vector<4, std::uint32_t, double> elements;
+    for (std::uint32_t i = 0; i < 10; i++) {
+      elements.push_back(i, i * 2.0);
+    }
+
+    CHECK(elements.page_count() == 3);
+    CHECK(elements.column<0>(0).size() == 4);
+    CHECK(elements.column<0>(2).size() == 2);
+    CHECK(elements.column<1>(2)[1] == 18.0);
+    CHECK(reinterpret_cast<std::uintptr_t>(elements.column<0>(1).data()) % 64 == 0);
+    CHECK(reinterpret_cast<std::uintptr_t>(elements.column<1>(1).data()) % 64 == 0);
+
+    std::uint32_t id_sum = 0;
+    elements.for_each_page<0>([&id_sum](std::span<std::uint32_t> ids) {
+      for (std::uint32_t id : ids) {
+        id_sum += id;
+      }
+    });
+    CHECK(id_sum == 45);
+
+    elements.for_each_page<1, 0>([](std::span<double> values, std::span<std::uint32_t> ids) {
+      for (std::size_t i = 0; i < values.size(); i++) {
+        values[i] += ids[i];
+      }
+    });
+    CHECK(elements.get<1>(9) == 27.0);
+  }
+
+  SECTION("Trim") {
+    const std::size_t bytes_before = ccol::allocated_bytes();
+    {
+      ccol::soa_vector<4, std::string, std::uint64_t> elements;
+      for (std::uint32_t i = 0; i < 16; i++) {
+        elements.push_back(std::to_string(i), i);
+      }
+
+      CHECK(elements.capacity() == 16);
+      CHECK(ccol::allocated_bytes() == bytes_before + elements.memory_bytes());
+
+      elements.clear();
+      elements.push_back("a", 1);
+      elements.trim(2);
+      CHECK(elements.capacity() == 8);
+      CHECK(elements.get<0>(0) == "a");
+      CHECK(elements.get<0>(1).empty());
+
+      elements.shrink_to_fit();
+      CHECK(elements.capacity() == 4);
+      CHECK(ccol::allocated_bytes() == bytes_before + elements.memory_bytes());
+    }
+    CHECK(ccol::allocated_bytes() == bytes_before);
+  }
+}
+
+TEST_CASE("SoaVector MT Access", "[soavector]") {
+  ccol::soa_vector<1024, std::uint32_t, std::uint32_t> elements;
+  std::barrier sync_point(3);
+
+  {
+    auto push = [&elements, &sync_point]() {
+      sync_point.arrive_and_wait();
+      for (std::uint32_t i = 1; i < 64000; i++) {
+        elements.push_back(i, i * 2);
+      }
+    };
+
+    std::jthread push_thread_1(push);
+    std::jthread push_thread_2(push);
+
+    sync_point.arrive_and_wait();
+    for (std::uint32_t i = 0; i < elements.size(); i++) {
+      auto [value, doubled] = elements[i];
+      CHECK(value > 0);
+      CHECK(doubled == value * 2);
+    }
+
+    // every column of a page has to cover the same elements while appends are running
+    std::uint32_t mismatches = 0;
+    for (std::uint32_t pass = 0; pass < 64; pass++) {
+      elements.for_each_page<1, 0>([&mismatches](std::span<const std::uint32_t> doubled,
+                                                 std::span<const std::uint32_t> values) {
+        mismatches += doubled.size() == values.size() ? 0 : 1;
+        for (std::size_t i = 0; i < std::min(doubled.size(), values.size()); i++) {
+          mismatches += doubled[i] == values[i] * 2 ? 0 : 1;
+        }
+      });
+    }
+    CHECK(mismatches == 0);
+  }
+
+  CHECK(elements.size() == 2 * 63999);
+}
@@ -56,6 +56,48 @@ TEST_CASE("SparseVector Basic Operations", "[svector]") {
     CHECK(elements[2] == "2");
   }
 
+  SECTION("Reuse After Clear") {
+    ccol::sparse_vector<std::string, 2> elements;
+    elements.push_back("0");
+    elements.push_back("1");
+    elements.push_back("2");
+    elements.clear();
+    elements.push_back("3");
+    elements.push_back("4");
+
+    CHECK(elements.size() == 2);
+    CHECK(elements[0] == "3");
+    CHECK(elements[1] == "4");
+  }
+
+  SECTION("Trim") {
+    const std::size_t bytes_before = ccol::allocated_bytes();
+    {
+      ccol::sparse_vector<std::string, 4> elements;
+      for (std::uint32_t i = 0; i < 16; i++) {
+        elements.push_back(std::to_string(i));
+      }
+
+      CHECK(elements.capacity() == 16);
+      CHECK(elements.memory_bytes() > 0);
+      CHECK(ccol::allocated_bytes() == bytes_before + elements.memory_bytes());
+
+      elements.clear();
+      elements.push_back("a");
+      elements.trim(2);
+      CHECK(elements.capacity() == 8);
+      CHECK(elements[0] == "a");
+
+      elements.shrink_to_fit();
+      CHECK(elements.capacity() == 4);
+      CHECK(ccol::allocated_bytes() == bytes_before + elements.memory_bytes());
+
+      elements.push_back("b");
+      CHECK(elements[1] == "b");
+    }
+    CHECK(ccol::allocated_bytes() == bytes_before);
+  }
+
   SECTION("Construction/Destruction Test") {
     ccol::sparse_vector<ConstructorDestructorTester, 512> elements;
     elements.emplace_back({});
@@ -0,0 +1,106 @@
+//
+// Copyright (c) 2023 Paper Cranes Ltd.
+// All rights reserved.
+//
+#include <catch2/catch_all.hpp>
+#include <ccol/static_trivial_vector.h>
+
+#include <barrier>
+
+constinit ccol::static_trivial_vector<std::uint32_t, 8> constant_elements;
+
+TEST_CASE("StaticTrivialVector Basic Operations", "[stvector]") {
+  SECTION("Integer Elements") {
+    ccol::static_trivial_vector<std::uint32_t, 8> elements;
+    elements.push_back(0);
+    elements.push_back(1);
+    elements.push_back(2);
+
+    CHECK(elements.size() == 3);  // NOLINT(*-container-size-empty)
+
+    for (std::uint32_t i = 0; i < elements.size(); i++) {
+      CHECK(elements[i] == i);
+    }
+
+    std::uint32_t ix = 0;
+    for (std::uint32_t element : elements) {
+      CHECK(element == ix++);
+    }
+  }
+
+  SECTION("Constant Initialization") {
+    CHECK(constant_elements.empty());
+    CHECK(constant_elements.capacity() == 8);
+    static_assert(ccol::static_trivial_vector<std::uint32_t, 8>::memory_bytes() == 8 * sizeof(std::uint32_t));
+
+    ccol::static_trivial_vector<std::uint32_t, 4> elements{3, 2, 1};
+    CHECK(elements.size() == 3);
+    CHECK(elements[0] == 3);
+    CHECK(elements[2] == 1);
+
+    auto too_many = [] { ccol::static_trivial_vector<std::uint32_t, 2> overflowing{3, 2, 1}; };
+    CHECK_THROWS_AS(too_many(), std::length_error);
+  }
+
+  SECTION("Capacity") {
+    ccol::static_trivial_vector<std::uint32_t, 4> elements;
+    CHECK(elements.try_append(std::array<std::uint32_t, 3>{0, 1, 2}));
+    CHECK(!elements.try_append(std::array<std::uint32_t, 2>{3, 4}));
+    CHECK(elements.try_push_back(3));
+    CHECK(!elements.try_push_back(4));
+    CHECK(elements.size() == 4);
+
+    // the throwing versions never drop values, even with NDEBUG
+    CHECK_THROWS_AS(elements.push_back(4), std::length_error);
+    CHECK_THROWS_AS(elements.append(std::array<std::uint32_t, 1>{4}), std::length_error);
+    CHECK_THROWS_AS(elements.resize(5), std::length_error);
+    CHECK(elements.size() == 4);
+
+    elements.resize(2);
+    CHECK(elements.size() == 2);
+    CHECK(elements.try_push_back(5));
+    CHECK(elements[2] == 5);
+
+    elements.clear();
+    CHECK(elements.empty());
+  }
+
+  SECTION("Replace And Exchange") {
+    ccol::static_trivial_vector<std::uint32_t, 4> elements{0, 1};
+    elements.replace(0, 10);
+    CHECK(elements.exchange(1, 11) == 1);
+    CHECK(elements[0] == 10);
+    CHECK(elements[1] == 11);
+  }
+}
+
+TEST_CASE("StaticTrivialVector MT Access", "[stvector]") {
+  constexpr std::uint32_t per_thread = 64000;
+  ccol::static_trivial_vector<std::uint32_t, per_thread * 2> elements;
+  std::barrier sync_point(3);
+
+  {
+    auto push = [&elements, &sync_point](std::uint32_t first) {
+      sync_point.arrive_and_wait();
+      for (std::uint32_t i = first; i < first + per_thread; i++) {
+        elements.push_back(i);
+      }
+    };
+
+    std::jthread push_thread_1(push, 0);
+    std::jthread push_thread_2(push, per_thread);
+
+    sync_point.arrive_and_wait();
+    for (std::uint32_t i = 0; i < elements.size(); i++) {
+      CHECK(elements[i] < per_thread * 2);
+    }
+  }
+
+  REQUIRE(elements.size() == per_thread * 2);
+  std::vector<std::uint32_t> sorted(elements.begin(), elements.end());
+  std::sort(sorted.begin(), sorted.end());
+  for (std::uint32_t i = 0; i < sorted.size(); i++) {
+    REQUIRE(sorted[i] == i);
+  }
+  CHECK(!elements.try_push_back(0));
+}
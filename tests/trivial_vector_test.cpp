@@ -68,6 +68,42 @@ TEST_CASE("TrivialVector Basic Operations", "[tvector]") {
 
     CHECK(elements[0] == TrivialPoint{0.0f, 0.0f});
   }
+
+  SECTION("Memory Accounting") {
+    const std::size_t bytes_before = ccol::allocated_bytes();
+    {
+      ccol::trivial_vector<std::uint32_t> elements;
+      CHECK(elements.capacity() == 0);
+      CHECK(elements.memory_bytes() == 0);
+
+      for (std::uint32_t i = 0; i < 100; i++) {
+        elements.push_back(i);
+      }
+
+      CHECK(elements.capacity() >= 100);
+      CHECK(elements.memory_bytes() == elements.capacity() * sizeof(std::uint32_t));
+      CHECK(ccol::allocated_bytes() == bytes_before + elements.memory_bytes());
+
+      elements.resize(10);
+      elements.shrink_to_fit();
+      CHECK(elements.capacity() == 10);
+      CHECK(ccol::allocated_bytes() == bytes_before + 10 * sizeof(std::uint32_t));
+      for (std::uint32_t i = 0; i < elements.size(); i++) {
+        CHECK(elements[i] == i);
+      }
+
+      elements.clear();
+      elements.shrink_to_fit();
+      CHECK(elements.capacity() == 0);
+      CHECK(ccol::allocated_bytes() == bytes_before);
+      // an index from before the shrink doesn't reach the freed buffer
+      CHECK_THROWS_AS(elements[5], std::out_of_range);
+
+      elements.push_back(42);
+      CHECK(elements[0] == 42);
+    }
+    CHECK(ccol::allocated_bytes() == bytes_before);
+  }
 }
 
 TEST_CASE("TrivialVector MT Access", "[tvector][!mayfail][!throws]") {